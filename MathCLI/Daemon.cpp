@@ -0,0 +1,418 @@
+﻿#include "Daemon.h"
+#include "Script.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+namespace mathcli {
+
+    int runDaemon(const DaemonOptions&) {
+        std::cout << "Ошибка: режим демона поддерживается только на платформах с Unix-сокетами.\n";
+        return 1;
+    }
+
+    int runClient(const std::string&, std::istream&, std::ostream&) {
+        std::cout << "Ошибка: режим клиента поддерживается только на платформах с Unix-сокетами.\n";
+        return 1;
+    }
+
+} // namespace mathcli
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "MathCore/Interpreter.h"
+
+namespace mathcli {
+
+    namespace {
+
+        constexpr uint32_t kMaxFrame = 64u * 1024u * 1024u;
+        constexpr size_t kHeader = 5;
+
+        using Clock = std::chrono::steady_clock;
+
+        // Сокеты сессий неблокирующие: запись ждёт готовности не дольше timeoutMs (-1 — без лимита).
+        bool writeAll(int fd, const char* p, size_t n, int timeoutMs = -1) {
+            while (n) {
+                const ssize_t w = ::write(fd, p, n);
+                if (w < 0 && errno == EINTR) continue;
+                if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    pollfd pfd{ fd, POLLOUT, 0 };
+                    const int r = ::poll(&pfd, 1, timeoutMs);
+                    if (r < 0 && errno == EINTR) continue;
+                    if (r <= 0) return false;
+                    continue;
+                }
+                if (w <= 0) return false;
+                p += w;
+                n -= static_cast<size_t>(w);
+            }
+            return true;
+        }
+
+        bool readAll(int fd, char* p, size_t n) {
+            while (n) {
+                const ssize_t r = ::read(fd, p, n);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) return false;
+                p += r;
+                n -= static_cast<size_t>(r);
+            }
+            return true;
+        }
+
+        bool sendFrame(int fd, FrameType type, const std::string& payload, int timeoutMs = -1) {
+            const uint32_t len = static_cast<uint32_t>(payload.size());
+            char hdr[kHeader] = {
+                static_cast<char>(len >> 24), static_cast<char>(len >> 16),
+                static_cast<char>(len >> 8), static_cast<char>(len),
+                static_cast<char>(type)
+            };
+            return writeAll(fd, hdr, sizeof(hdr), timeoutMs) && writeAll(fd, payload.data(), payload.size(), timeoutMs);
+        }
+
+        uint32_t frameLength(const unsigned char* hdr) {
+            return (uint32_t(hdr[0]) << 24) | (uint32_t(hdr[1]) << 16) | (uint32_t(hdr[2]) << 8) | uint32_t(hdr[3]);
+        }
+
+        bool recvFrame(int fd, FrameType& type, std::string& payload) {
+            unsigned char hdr[kHeader];
+            if (!readAll(fd, reinterpret_cast<char*>(hdr), sizeof(hdr))) return false;
+            const uint32_t len = frameLength(hdr);
+            if (len > kMaxFrame) return false;
+            type = static_cast<FrameType>(hdr[4]);
+            payload.resize(len);
+            return len == 0 || readAll(fd, &payload[0], len);
+        }
+
+        bool makeAddress(const std::string& path, sockaddr_un& addr) {
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        // Фиксированный пул рабочих потоков с общей очередью задач.
+        class WorkerPool {
+        public:
+            explicit WorkerPool(unsigned n) {
+                for (unsigned i = 0; i < n; ++i) m_threads.emplace_back([this] { loop(); });
+            }
+
+            ~WorkerPool() {
+                {
+                    std::lock_guard<std::mutex> lk(m_mx);
+                    m_stop = true;
+                }
+                m_cv.notify_all();
+                for (auto& t : m_threads) t.join();
+            }
+
+            void submit(std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lk(m_mx);
+                    m_tasks.push_back(std::move(task));
+                }
+                m_cv.notify_one();
+            }
+
+        private:
+            void loop() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lk(m_mx);
+                        m_cv.wait(lk, [this] { return m_stop || !m_tasks.empty(); });
+                        if (m_tasks.empty()) return;
+                        task = std::move(m_tasks.front());
+                        m_tasks.pop_front();
+                    }
+                    task();
+                }
+            }
+
+            std::vector<std::thread> m_threads;
+            std::deque<std::function<void()>> m_tasks;
+            std::mutex m_mx;
+            std::condition_variable m_cv;
+            bool m_stop{ false };
+        };
+
+        struct Session {
+            Session(int fd_, std::shared_ptr<const mathcore::Context> base) : fd(fd_), interp(std::move(base)) {}
+            int fd;
+            mathcore::Interpreter interp;
+            bool busy{ false }; // запрос выполняется в пуле; сокет не опрашивается
+
+            // Кадр собирается из неблокирующих чтений; трогает только главный поток.
+            std::string inbuf;
+            Clock::time_point frameStart; // когда пришёл первый байт незаконченного кадра
+        };
+
+        enum class ReadStatus { Pending, Frame, Closed, Invalid };
+
+        // Дочитывает доступные байты сокета в буфер сессии, не блокируясь. Frame — в буфере
+        // целый кадр (возвращается в type/payload); Pending — нужно ждать ещё данных.
+        ReadStatus takeFrame(Session& s, bool readSocket, FrameType& type, std::string& payload) {
+            char chunk[65536];
+            while (readSocket) {
+                // Не дальше конца текущего кадра: следующий дочитается, когда сессия освободится
+                size_t want = sizeof(chunk);
+                if (s.inbuf.size() >= kHeader) {
+                    const size_t total = kHeader + frameLength(reinterpret_cast<const unsigned char*>(s.inbuf.data()));
+                    if (s.inbuf.size() >= total) break;
+                    want = std::min(want, total - s.inbuf.size());
+                }
+                else {
+                    want = kHeader - s.inbuf.size();
+                }
+                const ssize_t r = ::read(s.fd, chunk, want);
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (r <= 0) return ReadStatus::Closed;
+                if (s.inbuf.empty()) s.frameStart = Clock::now();
+                s.inbuf.append(chunk, static_cast<size_t>(r));
+                if (s.inbuf.size() >= kHeader &&
+                    frameLength(reinterpret_cast<const unsigned char*>(s.inbuf.data())) > kMaxFrame)
+                    return ReadStatus::Invalid;
+            }
+
+            if (s.inbuf.size() < kHeader) return ReadStatus::Pending;
+            const size_t len = frameLength(reinterpret_cast<const unsigned char*>(s.inbuf.data()));
+            if (len > kMaxFrame) return ReadStatus::Invalid;
+            if (s.inbuf.size() < kHeader + len) return ReadStatus::Pending;
+            type = static_cast<FrameType>(s.inbuf[4]);
+            payload.assign(s.inbuf, kHeader, len);
+            s.inbuf.erase(0, kHeader + len);
+            if (!s.inbuf.empty()) s.frameStart = Clock::now();
+            return ReadStatus::Frame;
+        }
+
+        std::atomic<bool> g_stop{ false };
+        int g_wakeWrite = -1;
+
+        void wake() {
+            const char b = 0;
+            if (g_wakeWrite >= 0) (void)!::write(g_wakeWrite, &b, 1);
+        }
+
+        void onStopSignal(int) {
+            g_stop = true;
+            wake();
+        }
+
+    } // namespace
+
+    int runDaemon(const DaemonOptions& opts) {
+        // Общие переменные: выполняем сценарий один раз и замораживаем контекст.
+        mathcore::Interpreter baseInterp;
+        if (!opts.baseScript.empty()) {
+            std::ifstream in(opts.baseScript);
+            if (!in) {
+                std::cout << "Ошибка: не удалось открыть файл: " << opts.baseScript << "\n";
+                return 1;
+            }
+            runScript(baseInterp, in, std::cout);
+        }
+        auto base = std::make_shared<const mathcore::Context>(baseInterp.ctx());
+
+        sockaddr_un addr;
+        if (!makeAddress(opts.socketPath, addr)) {
+            std::cout << "Ошибка: некорректный путь сокета: " << opts.socketPath << "\n";
+            return 1;
+        }
+
+        const int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (lfd < 0) { std::cout << "Ошибка: socket(): " << std::strerror(errno) << "\n"; return 1; }
+        ::unlink(opts.socketPath.c_str());
+        if (::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(lfd, 128) < 0) {
+            std::cout << "Ошибка: не удалось открыть сокет " << opts.socketPath << ": " << std::strerror(errno) << "\n";
+            ::close(lfd);
+            return 1;
+        }
+
+        int wakeFds[2];
+        if (::pipe(wakeFds) < 0) { ::close(lfd); return 1; }
+        ::fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+        g_wakeWrite = wakeFds[1];
+
+        std::signal(SIGPIPE, SIG_IGN);
+        std::signal(SIGINT, onStopSignal);
+        std::signal(SIGTERM, onStopSignal);
+
+        const unsigned workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+
+        std::mutex mx;
+        std::map<int, std::shared_ptr<Session>> sessions;
+        auto closeSession = [&](int fd) {
+            {
+                std::lock_guard<std::mutex> lk(mx);
+                sessions.erase(fd);
+            }
+            // Закрываем после удаления из таблицы: accept() может сразу выдать тот же номер.
+            ::close(fd);
+        };
+
+        const int ioTimeoutMs = opts.ioTimeout.count() ? static_cast<int>(opts.ioTimeout.count()) : -1;
+
+        {
+            WorkerPool pool(workers);
+
+            while (!g_stop) {
+                std::vector<pollfd> fds{ { lfd, POLLIN, 0 }, { wakeFds[0], POLLIN, 0 } };
+                bool partial = false;
+                {
+                    std::lock_guard<std::mutex> lk(mx);
+                    for (auto& kv : sessions) {
+                        if (kv.second->busy) continue;
+                        fds.push_back({ kv.first, POLLIN, 0 });
+                        if (!kv.second->inbuf.empty()) partial = true;
+                    }
+                }
+
+                // Пока есть незаконченные кадры, просыпаемся и без событий — проверить тайм-аут.
+                const int pollMs = partial && ioTimeoutMs >= 0 ? std::min(ioTimeoutMs, 1000) : -1;
+                if (::poll(fds.data(), fds.size(), pollMs) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+
+                if (fds[1].revents) {
+                    char buf[256];
+                    while (::read(wakeFds[0], buf, sizeof(buf)) > 0) {}
+                }
+
+                if (fds[0].revents & POLLIN) {
+                    const int cfd = ::accept(lfd, nullptr, nullptr);
+                    if (cfd >= 0) {
+                        // Кадры читаются без блокировки: медленный клиент не задерживает остальных
+                        ::fcntl(cfd, F_SETFL, ::fcntl(cfd, F_GETFL) | O_NONBLOCK);
+                        std::lock_guard<std::mutex> lk(mx);
+                        auto s = std::make_shared<Session>(cfd, base);
+                        s->interp.setMemoryLimit(opts.memLimit);
+                        s->interp.setParallelOptions(opts.parallel);
+                        s->interp.setTimeLimits(opts.timeLimits);
+                        sessions[cfd] = std::move(s);
+                    }
+                }
+
+                // Сокеты без событий тоже проверяются: кадр мог прийти целиком вместе с предыдущим.
+                for (size_t k = 2; k < fds.size(); ++k) {
+                    const int fd = fds[k].fd;
+                    std::shared_ptr<Session> s;
+                    {
+                        std::lock_guard<std::mutex> lk(mx);
+                        auto it = sessions.find(fd);
+                        if (it != sessions.end()) s = it->second;
+                    }
+                    if (!s) continue; // закрыта рабочим потоком после опроса
+
+                    FrameType type{};
+                    std::string payload;
+                    const ReadStatus st = takeFrame(*s, fds[k].revents != 0, type, payload);
+                    if (st == ReadStatus::Pending) {
+                        if (!s->inbuf.empty() && ioTimeoutMs >= 0 && Clock::now() - s->frameStart > opts.ioTimeout)
+                            closeSession(fd);
+                        continue;
+                    }
+                    if (st != ReadStatus::Frame || type == FrameType::Quit) {
+                        closeSession(fd);
+                        continue;
+                    }
+                    if (type != FrameType::Execute) {
+                        sendFrame(fd, FrameType::Error, "Неизвестный тип кадра.", 0);
+                        closeSession(fd);
+                        continue;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lk(mx);
+                        s->busy = true;
+                    }
+                    pool.submit([s, payload = std::move(payload), ioTimeoutMs, &mx, &closeSession] {
+                        std::istringstream in(payload);
+                        std::ostringstream out;
+                        runScript(s->interp, in, out);
+                        if (!sendFrame(s->fd, FrameType::Output, out.str(), ioTimeoutMs)) {
+                            closeSession(s->fd);
+                        }
+                        else {
+                            std::lock_guard<std::mutex> lk(mx);
+                            s->busy = false;
+                        }
+                        wake();
+                    });
+                }
+            }
+        } // пул дожидается выполняющихся запросов
+
+        for (auto& kv : sessions) ::close(kv.first);
+        ::close(lfd);
+        ::unlink(opts.socketPath.c_str());
+        g_wakeWrite = -1;
+        ::close(wakeFds[0]);
+        ::close(wakeFds[1]);
+        return 0;
+    }
+
+    int runClient(const std::string& socketPath, std::istream& script, std::ostream& out) {
+        sockaddr_un addr;
+        if (!makeAddress(socketPath, addr)) {
+            out << "Ошибка: некорректный путь сокета: " << socketPath << "\n";
+            return 1;
+        }
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            out << "Ошибка: не удалось подключиться к " << socketPath << ": " << std::strerror(errno) << "\n";
+            if (fd >= 0) ::close(fd);
+            return 1;
+        }
+        std::signal(SIGPIPE, SIG_IGN);
+
+        std::ostringstream buf;
+        buf << script.rdbuf();
+
+        FrameType type;
+        std::string reply;
+        const bool ok = sendFrame(fd, FrameType::Execute, buf.str()) && recvFrame(fd, type, reply);
+        if (ok) sendFrame(fd, FrameType::Quit, "");
+        ::close(fd);
+
+        if (!ok) {
+            out << "Ошибка: соединение с демоном прервано.\n";
+            return 1;
+        }
+        out << reply;
+        return type == FrameType::Output ? 0 : 1;
+    }
+
+} // namespace mathcli
+
+#endif
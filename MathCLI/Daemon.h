@@ -0,0 +1,38 @@
+﻿#pragma once
+#include "MathCore/Cancellation.h"
+#include "MathCore/Parallelism.h"
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+
+namespace mathcli {
+
+    // Протокол поверх Unix-сокета: каждый кадр — 4 байта длины (big-endian),
+    // 1 байт типа и полезная нагрузка (длина считает только нагрузку).
+    //   клиент -> демон: 'E' <текст сценария>  — выполнить строки в сессии соединения
+    //                    'Q'                   — завершить сессию
+    //   демон -> клиент: 'O' <вывод>           — то же, что напечатал бы режим файла
+    //                    'X' <сообщение>       — ошибка протокола, соединение закрывается
+    // Одно соединение = одна сессия со своим Interpreter.
+    enum class FrameType : char { Execute = 'E', Quit = 'Q', Output = 'O', Error = 'X' };
+
+    struct DaemonOptions {
+        std::string socketPath;
+        unsigned workers{ 0 };     // 0 — по числу аппаратных потоков
+        std::string baseScript;    // сценарий общих переменных, выполняется один раз
+        size_t memLimit{ 0 };      // лимит памяти каждой сессии в байтах, 0 — без лимита
+        mathcore::ParallelOptions parallel; // распараллеливание операций каждой сессии
+        mathcore::TimeLimits timeLimits;    // лимиты времени строки и сессии
+        // Сколько ждать остаток начатого кадра и запись ответа; медленный клиент
+        // отключается, не задерживая остальные сессии.
+        std::chrono::milliseconds ioTimeout{ 30000 };
+    };
+
+    // Запускает демон и блокируется до SIGINT/SIGTERM. Возвращает код завершения процесса.
+    int runDaemon(const DaemonOptions& opts);
+
+    // Отправляет сценарий демону одним кадром и печатает ответ.
+    int runClient(const std::string& socketPath, std::istream& script, std::ostream& out);
+
+} // namespace mathcli
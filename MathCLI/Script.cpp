@@ -0,0 +1,193 @@
+﻿#include "Script.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "MathCore/Errors.h"
+#include "MathCore/Optimizer.h"
+#include "MathCore/Parser.h"
+
+namespace mathcli {
+
+    namespace {
+
+        void syntaxError(std::ostream& out, int lineNo, int col, const char* what) {
+            out << "Синтаксическая ошибка (строка " << lineNo << ", позиция " << col << "): " << what << "\n";
+        }
+
+        // Выполняет уже разобранную строку; ошибку вычисления печатает в err.
+        // Отмена токеном (Ctrl-C) или исчерпанный лимит сессии взводят cancelled: следующие
+        // строки всё равно завершились бы той же ошибкой, поэтому сценарий останавливается.
+        // Превышение лимита строки останавливает только эту строку.
+        template <class Run>
+        std::optional<mathcore::ValuePtr> evaluate(mathcore::Interpreter& interp, int lineNo, std::ostream& err,
+            bool& cancelled, const Run& run) {
+            try {
+                return run();
+            }
+            catch (const mathcore::ParseError& e) {
+                syntaxError(err, lineNo, e.col, e.what());
+            }
+            catch (const mathcore::CancelledError& e) {
+                cancelled = interp.cancelToken().cancelled() || interp.sessionTimeExhausted();
+                err << "Ошибка вычисления (строка " << lineNo << "): " << e.what()
+                    << (cancelled ? " Сценарий остановлен." : "") << "\n";
+            }
+            catch (const mathcore::EvalError& e) {
+                err << "Ошибка вычисления (строка " << lineNo << "): " << e.what() << "\n";
+            }
+            catch (const std::exception& e) {
+                err << "Неизвестная ошибка (строка " << lineNo << "): " << e.what() << "\n";
+            }
+            return std::nullopt;
+        }
+
+        struct ParsedLine {
+            int lineNo{ 0 };
+            mathcore::Statement stmt;
+            std::optional<mathcore::Diagnostic> error;
+            std::string failure; // сбой стадии чтения: печатается как есть, строк дальше нет
+        };
+
+        struct LineOutput {
+            int lineNo{ 0 };
+            mathcore::ValuePtr value;  // результат для печати (формирует стадия вывода)
+            std::string text;          // готовый текст ошибки
+        };
+
+        // Очереди передают строки пачками, чтобы синхронизация не стоила дороже
+        // короткой строки; пустая пачка отмечает конец потока.
+        constexpr size_t kBatchLines = 64;
+        constexpr size_t kQueueDepth = 16;
+        constexpr size_t kFlushBytes = size_t(1) << 16;
+
+    } // namespace
+
+    void runScript(mathcore::Interpreter& interp, std::istream& in, std::ostream& out) {
+        std::string line;
+        int lineNo = 0;
+        bool cancelled = false;
+        while (!cancelled && std::getline(in, line)) {
+            ++lineNo;
+            if (line.empty()) continue;
+
+            auto res = evaluate(interp, lineNo, out, cancelled, [&] { return interp.executeLine(line); });
+            if (res && *res) out << (*res)->toString() << "\n";
+        }
+    }
+
+    void runScriptPipelined(mathcore::Interpreter& interp, std::istream& in, std::ostream& out) {
+        // На одном ядре стадии только отнимали бы время друг у друга.
+        if (std::thread::hardware_concurrency() < 2) return runScript(interp, in, out);
+
+        SpscQueue<std::vector<ParsedLine>, kQueueDepth> parsed;
+        SpscQueue<std::vector<LineOutput>, kQueueDepth> printed;
+        std::atomic<bool> stop{ false }; // вычисление отменено: дальше не читать
+
+        // Стадия 1: чтение, разбор и оптимизация строк. Свёртка констант зависит от режима,
+        // а директивы mode вычислитель применит позже: читатель ведёт режим сам, по тем же строкам.
+        std::thread reader([&, mode = interp.numericMode()]() mutable {
+            std::string line;
+            int lineNo = 0;
+            std::vector<ParsedLine> batch;
+            try {
+                while (!stop.load(std::memory_order_relaxed) && std::getline(in, line)) {
+                    ++lineNo;
+                    if (line.empty()) continue;
+                    auto res = mathcore::Parser::parseLine(line);
+                    if (!res.error) {
+                        if (res.stmt.mode) mode = *res.stmt.mode;
+                        mathcore::optimize(res.stmt, mode);
+                    }
+                    batch.push_back(ParsedLine{ lineNo, std::move(res.stmt), std::move(res.error), {} });
+                    if (batch.size() == kBatchLines) parsed.push(std::exchange(batch, {}));
+                }
+            }
+            catch (const std::exception& e) {
+                // Прочитанное выполняется, затем ошибка выводится на месте строки, где чтение прервалось.
+                batch.push_back(ParsedLine{ lineNo, {}, std::nullopt,
+                    "Ошибка чтения сценария (строка " + std::to_string(lineNo) + "): " + e.what() + "\n" });
+            }
+            catch (...) {
+                batch.push_back(ParsedLine{ lineNo, {}, std::nullopt,
+                    "Ошибка чтения сценария (строка " + std::to_string(lineNo) + ").\n" });
+            }
+            if (!batch.empty()) parsed.push(std::move(batch));
+            parsed.push({});
+        });
+
+        // Стадия 3: toString и запись большими кусками.
+        std::thread writer([&] {
+            std::string buf;
+            buf.reserve(kFlushBytes * 2);
+            for (auto batch = printed.pop(); !batch.empty(); batch = printed.pop()) {
+                for (auto& o : batch) {
+                    if (o.value) {
+                        try {
+                            buf += o.value->toString();
+                            buf += '\n';
+                        }
+                        catch (const std::exception& e) {
+                            buf += "Неизвестная ошибка (строка " + std::to_string(o.lineNo) + "): " + e.what() + "\n";
+                        }
+                    }
+                    else {
+                        buf += o.text;
+                    }
+                    if (buf.size() >= kFlushBytes) {
+                        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+                        buf.clear();
+                    }
+                }
+            }
+            out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+            out.flush();
+        });
+
+        // Стадия 2: вычисление в текущем потоке — Interpreter не разделяется между потоками.
+        std::ostringstream err;
+        bool cancelled = false;
+        for (auto batch = parsed.pop(); !batch.empty(); batch = parsed.pop()) {
+            // После отмены пачки только вычерпываются, чтобы поток чтения дошёл до конца.
+            if (cancelled) continue;
+            std::vector<LineOutput> outBatch;
+            outBatch.reserve(batch.size());
+            for (auto& p : batch) {
+                if (cancelled) break;
+                LineOutput o;
+                o.lineNo = p.lineNo;
+                if (!p.failure.empty()) {
+                    err << p.failure;
+                }
+                else if (p.error) {
+                    syntaxError(err, p.lineNo, p.error->col, p.error->message.c_str());
+                }
+                else {
+                    auto res = evaluate(interp, p.lineNo, err, cancelled, [&] { return interp.execute(p.stmt); });
+                    if (cancelled) stop.store(true, std::memory_order_relaxed);
+                    if (res && *res) o.value = std::move(*res);
+                }
+                if (!o.value) {
+                    o.text = err.str();
+                    err.str(std::string());
+                    if (o.text.empty()) continue;
+                }
+                outBatch.push_back(std::move(o));
+            }
+            if (!outBatch.empty()) printed.push(std::move(outBatch));
+        }
+        printed.push({});
+
+        reader.join();
+        writer.join();
+    }
+
+} // namespace mathcli
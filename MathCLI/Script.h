@@ -0,0 +1,18 @@
+﻿#pragma once
+#include <iosfwd>
+
+#include "MathCore/Interpreter.h"
+
+namespace mathcli {
+
+    // Выполняет строки из потока по одной, печатая результаты и ошибки (с номером строки) в out.
+    // Отмена (Ctrl-C) или исчерпанный лимит времени сессии останавливают сценарий с одним
+    // сообщением; остальные строки не выполняются.
+    void runScript(mathcore::Interpreter& interp, std::istream& in, std::ostream& out);
+
+    // То же, но конвейером из трёх стадий: поток чтения и разбора, вычисление в
+    // вызывающем потоке, поток форматирования и буферизованной записи. Стадии связаны
+    // ограниченными lock-free очередями; порядок вывода и тексты ошибок — как у runScript.
+    void runScriptPipelined(mathcore::Interpreter& interp, std::istream& in, std::ostream& out);
+
+} // namespace mathcli
@@ -0,0 +1,70 @@
+﻿#pragma once
+// Ограниченная очередь «один писатель — один читатель» для стадий конвейера.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace mathcli {
+
+    // Кольцевой буфер на Capacity (степень двойки) элементов. push() ждёт свободного
+    // места, pop() — элемента: сначала короткий спин, затем засыпает на condition_variable.
+    // Пока спящих нет, push и pop mutex не берут.
+    template <class T, size_t Capacity>
+    class SpscQueue {
+        static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity должна быть степенью двойки");
+
+    public:
+        SpscQueue() : m_buf(Capacity) {}
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        void push(T v) {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            waitUntil([&] { return head - m_tail.load(std::memory_order_acquire) != Capacity; });
+            m_buf[head & (Capacity - 1)] = std::move(v);
+            m_head.store(head + 1, std::memory_order_release);
+            wake();
+        }
+
+        T pop() {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            waitUntil([&] { return m_head.load(std::memory_order_acquire) != tail; });
+            T v = std::move(m_buf[tail & (Capacity - 1)]);
+            m_tail.store(tail + 1, std::memory_order_release);
+            wake();
+            return v;
+        }
+
+    private:
+        template <class Ready>
+        void waitUntil(const Ready& ready) {
+            for (unsigned spin = 0; spin < 64; ++spin)
+                if (ready()) return;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            // Пара к барьеру в wake(): либо мы увидим новый индекс, либо wake() увидит нас.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_cv.wait(lock, ready);
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void wake() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_sleepers.load(std::memory_order_relaxed) == 0) return;
+            // Под mutex: спящий либо уже в wait, либо ещё проверит условие и увидит изменение.
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+
+        std::vector<T> m_buf;
+        alignas(64) std::atomic<size_t> m_head{ 0 };  // пишет только производитель
+        alignas(64) std::atomic<size_t> m_tail{ 0 };  // пишет только потребитель
+        alignas(64) std::atomic<unsigned> m_sleepers{ 0 };
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+    };
+
+} // namespace mathcli
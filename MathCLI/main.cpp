@@ -1,4 +1,8 @@
-﻿#include <Windows.h>
+﻿#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -7,12 +11,17 @@
 #include "MathCore/Interpreter.h"
 #include "MathCore/Errors.h"
 
+#include "Daemon.h"
+#include "Script.h"
+
 static void enableUtf8Console() {
+#ifdef _WIN32
     // Для UTF-8 в консоли Windows:
     // - cp 65001 (UTF-8)
     // - проект собран с /utf-8
     SetConsoleOutputCP(65001);
     SetConsoleCP(65001);
+#endif
 }
 
 static void printHelp() {
@@ -21,6 +30,8 @@ static void printHelp() {
         << "  помощь               - показать справку\n"
         << "  выход                - завершить\n"
         << "  файл <путь>          - выполнить команды из файла\n"
+        << "  сжать                - объединить одинаковые значения переменных в памяти\n"
+        << "  mem                  - переменные по занимаемой памяти\n"
         << "Синтаксис:\n"
         << "  X = выражение\n"
         << "  выражение\n"
@@ -31,8 +42,26 @@ static void printHelp() {
         << "  R = 1 / 3\n"
         << "  V3 = V2 * R\n"
         << "  M2 = T(M1)\n"
+        << "  M3 = M1 ^ 10\n"
+        << "  S = dot(V1, V2)      (также sum, mean, min, max, norm, trace)\n"
+        << "  X = solve(M1, V1)    (также det, inv, rank; разложение матрицы кэшируется)\n"
+        << "  V4 = V1 .* V2        (поэлементно: .* и ./; скаляр, строка и столбец расширяются)\n"
+        << "  D = open(\"a.tiles\")   (матрица на диске; операции + - * .* ./ T() идут по тайлам)\n"
+        << "  S = save(D * D, \"b.tiles\") (запись в файл; load(S) читает матрицу в память)\n"
+        << "  mode fast            (вычисления в double, результаты неточные; mode exact - обратно)\n"
         << "  V3\n"
-        << "  M2\n";
+        << "  M2\n"
+        << "Запуск:\n"
+        << "  MathCLI [--mem-limit <МБ>] [--threads N] [--grain N] [--time-limit <мс>] [<файл>]\n"
+        << "                                                   - выполнить файл (или REPL) с лимитом памяти\n"
+        << "  MathCLI --daemon <сокет> [--workers N] [--base <файл>] [--mem-limit <МБ>] [--threads N] [--grain N]\n"
+        << "                                                   - демон на Unix-сокете, сессия на соединение\n"
+        << "    --io-timeout <мс> - сколько ждать остаток кадра и запись ответа (0 - без лимита)\n"
+        << "    --threads N  - потоков на операцию над векторами и матрицами (1 - однопоточный режим)\n"
+        << "    --grain N    - с какого числа элементов операция делится между потоками\n"
+        << "    --time-limit <мс>, --session-time-limit <мс> - лимит времени строки / всей сессии\n"
+        << "  Ctrl-C во время вычисления прерывает текущую строку, переменные не меняются.\n"
+        << "  MathCLI --client <сокет> [<файл>]                - выполнить файл (или stdin) в демоне\n";
 }
 
 static void executeFile(mathcore::Interpreter& interp, const std::filesystem::path& p) {
@@ -47,26 +76,61 @@ static void executeFile(mathcore::Interpreter& interp, const std::filesystem::pa
         return;
     }
 
-    std::string line;
-    int lineNo = 0;
-    while (std::getline(in, line)) {
-        ++lineNo;
-        if (line.empty()) continue;
+    mathcli::runScriptPipelined(interp, in, std::cout);
+}
 
-        try {
-            auto res = interp.executeLine(line);
-            if (res && *res) std::cout << (*res)->toString() << "\n";
-        }
-        catch (const mathcore::ParseError& e) {
-            std::cout << "Синтаксическая ошибка (строка " << lineNo << ", позиция " << e.col << "): " << e.what() << "\n";
-        }
-        catch (const mathcore::EvalError& e) {
-            std::cout << "Ошибка вычисления (строка " << lineNo << "): " << e.what() << "\n";
-        }
-        catch (const std::exception& e) {
-            std::cout << "Неизвестная ошибка (строка " << lineNo << "): " << e.what() << "\n";
-        }
+static size_t parseMegabytes(const char* s) {
+    return static_cast<size_t>(std::stoull(s)) << 20;
+}
+
+// Параметры сессии, общие для режима файла, REPL и демона. false — не такой параметр.
+static bool parseSessionFlag(const std::string& flag, const char* value,
+    mathcore::ParallelOptions& opts, mathcore::TimeLimits& limits) {
+    if (flag == "--time-limit") {
+        limits.line = std::chrono::milliseconds(std::stoll(value));
+        return true;
+    }
+    if (flag == "--session-time-limit") {
+        limits.session = std::chrono::milliseconds(std::stoll(value));
+        return true;
+    }
+    if (flag == "--threads") {
+        opts.threads = static_cast<unsigned>(std::stoul(value));
+        mathcore::setThreadPoolSize(opts.threads);
+        return true;
     }
+    if (flag == "--grain") {
+        opts.grain = static_cast<size_t>(std::stoull(value));
+        return true;
+    }
+    return false;
+}
+
+// Ctrl-C: во время вычисления строки отменяет её, в ожидании ввода — завершает программу.
+static mathcore::CancelToken* g_cancel = nullptr;
+static volatile std::sig_atomic_t g_evaluating = 0;
+
+extern "C" void onInterrupt(int) {
+    if (!g_evaluating) std::_Exit(130);
+    g_cancel->cancel();
+    std::signal(SIGINT, onInterrupt); // на части платформ обработчик сбрасывается после вызова
+}
+
+// Выполнение команды REPL, которое можно прервать Ctrl-C.
+template <class F>
+static void interruptible(mathcore::Interpreter& interp, const F& f) {
+    interp.cancelToken().reset();
+    g_evaluating = 1;
+    f();
+    g_evaluating = 0;
+}
+
+static void printMemory(const mathcore::Interpreter& interp) {
+    for (auto& [name, bytes] : interp.memoryUsage())
+        std::cout << "  " << name << ": " << bytes << " байт\n";
+    std::cout << "Всего: " << interp.contextBytes() << " байт";
+    if (interp.memoryLimit()) std::cout << " (лимит " << interp.memoryLimit() << ")";
+    std::cout << "\n";
 }
 
 static std::string trimCmd(std::string s) {
@@ -81,15 +145,56 @@ static std::string trimCmd(std::string s) {
 int main(int argc, char** argv) {
     enableUtf8Console();
 
+    if (argc >= 3 && std::string(argv[1]) == "--daemon") {
+        mathcli::DaemonOptions opts;
+        opts.socketPath = argv[2];
+        for (int k = 3; k + 1 < argc; k += 2) {
+            const std::string flag = argv[k];
+            if (flag == "--workers") opts.workers = static_cast<unsigned>(std::stoul(argv[k + 1]));
+            else if (flag == "--base") opts.baseScript = argv[k + 1];
+            else if (flag == "--mem-limit") opts.memLimit = parseMegabytes(argv[k + 1]);
+            else if (flag == "--io-timeout") opts.ioTimeout = std::chrono::milliseconds(std::stoll(argv[k + 1]));
+            else if (!parseSessionFlag(flag, argv[k + 1], opts.parallel, opts.timeLimits)) {
+                std::cout << "Неизвестный параметр: " << flag << "\n";
+                return 1;
+            }
+        }
+        return mathcli::runDaemon(opts);
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "--client") {
+        if (argc >= 4) {
+            std::ifstream in(std::filesystem::u8path(argv[3]));
+            if (!in) { std::cout << "Ошибка: не удалось открыть файл: " << argv[3] << "\n"; return 1; }
+            return mathcli::runClient(argv[2], in, std::cout);
+        }
+        return mathcli::runClient(argv[2], std::cin, std::cout);
+    }
+
     mathcore::Interpreter interp;
+    mathcore::ParallelOptions parallel;
+    mathcore::TimeLimits limits;
+    int argi = 1;
+    for (; argi + 1 < argc && std::string(argv[argi]).rfind("--", 0) == 0; argi += 2) {
+        const std::string flag = argv[argi];
+        if (flag == "--mem-limit") interp.setMemoryLimit(parseMegabytes(argv[argi + 1]));
+        else if (!parseSessionFlag(flag, argv[argi + 1], parallel, limits)) {
+            std::cout << "Неизвестный параметр: " << flag << "\n";
+            return 1;
+        }
+    }
+    interp.setParallelOptions(parallel);
+    interp.setTimeLimits(limits);
 
     // Режим файла: MathCLI.exe <filePath>
-    if (argc >= 2) {
-        executeFile(interp, std::filesystem::path(argv[1]));
+    if (argc > argi) {
+        executeFile(interp, std::filesystem::path(argv[argi]));
         return 0;
     }
 
     std::cout << "Математический интерпретатор (введите 'помощь' для справки)\n";
+    g_cancel = &interp.cancelToken();
+    std::signal(SIGINT, onInterrupt);
 
     while (true) {
         std::cout << ">>> ";
@@ -98,6 +203,14 @@ int main(int argc, char** argv) {
 
         if (line == "выход") break;
         if (line == "помощь") { printHelp(); continue; }
+        if (line == "mem") {
+            printMemory(interp);
+            continue;
+        }
+        if (line == "сжать") {
+            std::cout << "Объединено значений: " << interp.internValues() << "\n";
+            continue;
+        }
 
         // команда: файл <путь>
         const std::string cmdFile = u8"файл ";
@@ -110,23 +223,25 @@ int main(int argc, char** argv) {
             }
 
             auto path = std::filesystem::u8path(raw);
-            executeFile(interp, path);
+            interruptible(interp, [&] { executeFile(interp, path); });
             continue;
         }
 
-        try {
-            auto res = interp.executeLine(line);
-            if (res && *res) std::cout << (*res)->toString() << "\n";
-        }
-        catch (const mathcore::ParseError& e) {
-            std::cout << "Синтаксическая ошибка (позиция " << e.col << "): " << e.what() << "\n";
-        }
-        catch (const mathcore::EvalError& e) {
-            std::cout << "Ошибка вычисления: " << e.what() << "\n";
-        }
-        catch (const std::exception& e) {
-            std::cout << "Неизвестная ошибка: " << e.what() << "\n";
-        }
+        interruptible(interp, [&] {
+            try {
+                auto res = interp.executeLine(line);
+                if (res && *res) std::cout << (*res)->toString() << "\n";
+            }
+            catch (const mathcore::ParseError& e) {
+                std::cout << "Синтаксическая ошибка (позиция " << e.col << "): " << e.what() << "\n";
+            }
+            catch (const mathcore::EvalError& e) {
+                std::cout << "Ошибка вычисления: " << e.what() << "\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Неизвестная ошибка: " << e.what() << "\n";
+            }
+        });
     }
 
     return 0;
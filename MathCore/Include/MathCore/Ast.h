@@ -0,0 +1,51 @@
+﻿#pragma once
+#include "MathCore/Value.h"
+#include "MathCore/Tokenizer.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mathcore {
+
+    enum class NodeKind {
+        Literal,    // готовое значение (число)
+        Variable,
+        Negate,     // унарный минус
+        Binary,     // op: Plus / Minus / Star / Slash / Caret
+        Call,       // name(args...)
+        MatrixLit,  // [ ... ; ... ]: элементы построчно в args, длины строк в rowSizes
+        Text        // "...": строка в name; допустима только как путь в open/save
+    };
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    // Узел дерева разбора одной строки. Узлы неизменяемы и могут разделяться.
+    struct Node {
+        NodeKind kind{ NodeKind::Literal };
+        TokType op{ TokType::End };
+        std::string name;
+        ValuePtr value;
+        std::vector<NodePtr> args;
+        std::vector<size_t> rowSizes;
+        int line{ 1 };
+        int col{ 1 };
+        // Номер ячейки кэша общих подвыражений (назначает оптимизатор); -1 — не кэшируется.
+        int slot{ -1 };
+    };
+
+    // Режим вычислений: точный (рациональные числа) или быстрый неточный (double).
+    enum class NumericMode { Exact, Fast };
+
+    // Разобранная строка. target пуст — строка является выражением;
+    // expr == nullptr — строка пустая или директива mode.
+    struct Statement {
+        std::string target;
+        NodePtr expr;
+        std::optional<NumericMode> mode; // строка "mode fast" / "mode exact"
+        size_t slots{ 0 }; // число ячеек кэша общих подвыражений
+    };
+
+} // namespace mathcore
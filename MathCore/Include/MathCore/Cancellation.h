@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+
+namespace mathcore {
+
+    // Флаг отмены вычислений. cancel() можно вызывать из другого потока
+    // и из обработчика сигнала; ядра проверяют флаг между блоками работы.
+    class CancelToken {
+    public:
+        void cancel() noexcept { m_cancelled.store(true, std::memory_order_relaxed); }
+        void reset() noexcept { m_cancelled.store(false, std::memory_order_relaxed); }
+        bool cancelled() const noexcept { return m_cancelled.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<bool> m_cancelled{ false };
+    };
+
+    // Бюджеты времени вычисления (0 — без ограничения).
+    struct TimeLimits {
+        std::chrono::milliseconds line{ 0 };     // на одну строку
+        std::chrono::milliseconds session{ 0 };  // суммарно на все строки интерпретатора
+    };
+
+} // namespace mathcore
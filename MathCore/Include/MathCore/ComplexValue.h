@@ -20,6 +20,14 @@ namespace mathcore {
         ValuePtr sub(const Value& rhs) const override;
         ValuePtr mul(const Value& rhs) const override;
         ValuePtr div(const Value& rhs) const override;
+        ValuePtr neg() const override;
+        ValuePtr pow(const Value& exponent) const override;
+
+        size_t footprint() const override { return sizeof(ComplexValue) + kSharedControlBlock; }
+
+    protected:
+        size_t computeHash() const override;
+        bool sameContent(const Value& other) const override;
 
     public:
         explicit ComplexValue(std::complex<double> v) : m_v(v) {}
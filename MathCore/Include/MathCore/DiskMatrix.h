@@ -0,0 +1,92 @@
+﻿#pragma once
+#include "MathCore/Value.h"
+#include "MathCore/Tokenizer.h"
+
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace mathcore {
+
+    class MappedFile;
+
+    // Матрица комплексных чисел (double) в файле, отображённом в память, — для данных,
+    // которые не помещаются в RAM. Файл разбит на квадратные тайлы; операции идут потоково
+    // по тайлам, поэтому в памяти процесса находятся только тайлы, обрабатываемые сейчас.
+    //
+    // Формат файла: заголовок TiledHeader, с kDataOffset — тайлы построчно (по строкам
+    // тайлов), внутри тайла tile x tile элементов построчно; края дополнены нулями.
+    //
+    // Результаты операций — новые матрицы во временных файлах (удаляются вместе со значением).
+    // Точные рациональные значения при записи на диск переводятся в double.
+    class DiskMatrixValue final : public Value {
+    public:
+        struct TiledHeader {
+            char magic[8];
+            uint64_t rows;
+            uint64_t cols;
+            uint64_t tile;
+        };
+        static constexpr uint64_t kDataOffset = 4096;
+        static constexpr uint64_t kDefaultTile = 256;  // 1 МБ на тайл
+
+        // Открывает файл с матрицей (open("файл") в сценарии).
+        static std::shared_ptr<DiskMatrixValue> open(const std::string& path);
+        // Новая матрица rows x cols из нулей; пустой path — временный файл.
+        static std::shared_ptr<DiskMatrixValue> create(uint64_t rows, uint64_t cols, const std::string& path = "",
+            uint64_t tile = kDefaultTile);
+
+        explicit DiskMatrixValue(std::shared_ptr<MappedFile> file);
+
+        ValueKind kind() const override { return ValueKind::DiskMatrix; }
+        std::string toString() const override;
+
+        ValuePtr add(const Value& rhs) const override;
+        ValuePtr sub(const Value& rhs) const override;
+        ValuePtr mul(const Value& rhs) const override;
+        ValuePtr div(const Value& rhs) const override;
+        ValuePtr emul(const Value& rhs) const override;
+        ValuePtr ediv(const Value& rhs) const override;
+        ValuePtr neg() const override;
+        ValuePtr transpose() const override;
+
+        uint64_t rows() const { return m_rows; }
+        uint64_t cols() const { return m_cols; }
+        uint64_t tile() const { return m_tile; }
+        uint64_t tileRows() const { return (m_rows + m_tile - 1) / m_tile; }
+        uint64_t tileCols() const { return (m_cols + m_tile - 1) / m_tile; }
+        const std::string& path() const;
+
+        // Тайл (ti, tj): tile x tile элементов построчно.
+        std::complex<double>* tileData(uint64_t ti, uint64_t tj) const;
+        void willNeedTile(uint64_t ti, uint64_t tj) const;
+        void dontNeedTile(uint64_t ti, uint64_t tj) const;
+
+        // Объект и отображение; сами данные лежат в файле.
+        size_t footprint() const override { return sizeof(DiskMatrixValue) + kSharedControlBlock + 256; }
+
+    protected:
+        size_t computeHash() const override;
+        bool sameContent(const Value& other) const override;
+
+    private:
+        uint64_t tileBytes() const { return m_tile * m_tile * sizeof(std::complex<double>); }
+
+        std::shared_ptr<MappedFile> m_file;
+        uint64_t m_rows{ 0 }, m_cols{ 0 }, m_tile{ 0 };
+    };
+
+    // Операция, где хотя бы один операнд — матрица на диске (вызывается из binaryOp).
+    // Второй операнд может быть скаляром или матрицей в памяти (она сначала пишется
+    // во временный файл); op: Plus, Minus, Star, Slash, DotStar, DotSlash.
+    ValuePtr diskBinaryOp(TokType op, const Value& left, const Value& right);
+
+    // Записывает матрицу (в памяти или на диске) в файл и открывает его: save(M, "файл").
+    ValuePtr saveDiskMatrix(const Value& m, const std::string& path);
+
+    // Читает матрицу с диска в память: load(D). Целые вещественные элементы становятся
+    // рациональными, остальные — комплексными.
+    ValuePtr loadDiskMatrix(const Value& m);
+
+} // namespace mathcore
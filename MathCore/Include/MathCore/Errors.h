@@ -4,15 +4,44 @@
 
 namespace mathcore {
 
+    enum class ErrorCode {
+        InvalidCharacter,   // недопустимый символ во входной строке
+        ExpectedExpression,
+        ExpectedLParen,
+        ExpectedRParen,
+        TrailingTokens,     // лишние токены в конце строки
+        UnknownMode,        // mode с чем-то кроме fast / exact
+        InvalidNumber,
+        UnknownVariable,
+        UnknownFunction,
+        Evaluation,         // ошибка при вычислении (размеры, деление на ноль и т.п.)
+        Cancelled           // вычисление отменено или вышло за лимит времени
+    };
+
+    // Структурированное описание ошибки для API без исключений.
+    struct Diagnostic {
+        ErrorCode code{ ErrorCode::Evaluation };
+        int line{ 1 };
+        int col{ 1 };
+        std::string message;
+    };
+
     struct ParseError : public std::runtime_error {
         int line;
         int col;
         explicit ParseError(int line_, int col_, const std::string& msg)
             : std::runtime_error(msg), line(line_), col(col_) {}
+        explicit ParseError(const Diagnostic& d)
+            : std::runtime_error(d.message), line(d.line), col(d.col) {}
     };
 
     struct EvalError : public std::runtime_error {
         explicit EvalError(const std::string& msg) : std::runtime_error(msg) {}
     };
 
+    // Строка отменена (CancelToken) или превысила лимит времени. Контекст при этом не меняется.
+    struct CancelledError : public EvalError {
+        explicit CancelledError(const std::string& msg) : EvalError(msg) {}
+    };
+
 } // namespace mathcore
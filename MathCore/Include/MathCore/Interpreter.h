@@ -2,46 +2,195 @@
 #include "MathCore/Value.h"
 #include "MathCore/Tokenizer.h"
 #include "MathCore/Errors.h"
+#include "MathCore/Ast.h"
+#include "MathCore/Parser.h"
 #include "MathCore/VectorMatrix.h"
 #include "MathCore/RationalValue.h"
 #include "MathCore/ComplexValue.h"
+#include "MathCore/Cancellation.h"
+#include "MathCore/Parallelism.h"
 
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace mathcore {
 
     struct Context {
         std::map<std::string, ValuePtr> vars;
+
+        // Общие переменные только для чтения (например, загруженные один раз
+        // и разделяемые несколькими интерпретаторами). Собственные vars их перекрывают.
+        std::shared_ptr<const Context> base;
+
+        // Номер версии: растёт с каждым опубликованным изменением (см. Interpreter::snapshot).
+        uint64_t version{ 0 };
+
+        // Ищет переменную сначала в vars, затем по цепочке base. nullptr, если не найдена.
+        const ValuePtr* find(const std::string& name) const;
+
+        // Дедупликация: структурно равные значения vars (в том числе равные значениям
+        // из base) начинают ссылаться на одно размещение. Значения неизменяемы, поэтому
+        // замена ссылки ничего не меняет в поведении. Возвращает число заменённых ссылок.
+        size_t intern();
+    };
+
+    // Результат tryExecuteLine: значение выражения (если строка не присваивание) либо ошибка.
+    struct LineResult {
+        std::optional<ValuePtr> value;
+        std::optional<Diagnostic> error;
+        bool ok() const { return !error; }
+    };
+
+    // Значения входных переменных одного прогона executeBatch.
+    using Bindings = std::map<std::string, ValuePtr>;
+
+    // Результат одного прогона сценария в executeBatch. Прогон останавливается на первой
+    // ошибке; Diagnostic::line — номер строки сценария.
+    struct BatchResult {
+        std::vector<ValuePtr> values;         // значения строк-выражений по порядку
+        std::map<std::string, ValuePtr> vars; // привязки и переменные, присвоенные сценарием
+        std::optional<Diagnostic> error;
+        bool ok() const { return !error; }
     };
 
     class Interpreter {
     public:
         Interpreter();
+        explicit Interpreter(std::shared_ptr<const Context> base);
 
         // Выполняет одну строку: либо присваивание, либо выражение.
         // Возвращает значение выражения, если строка не присваивание.
+        // Ошибки сообщаются исключениями ParseError / EvalError.
         std::optional<ValuePtr> executeLine(const std::string& line);
 
+        // Выполняет уже разобранную (и, возможно, оптимизированную) строку.
+        std::optional<ValuePtr> execute(const Statement& st);
+
+        // То же, что executeLine, но без исключений: ошибки разбора и неизвестные
+        // имена обнаруживаются до вычисления, ошибки вычисления (размеры, деление
+        // на ноль) вычислитель возвращает статусом; всё — как Diagnostic.
+        LineResult tryExecuteLine(const std::string& line);
+
+        // Предварительная проверка сценария без вычисления: разбор каждой строки и
+        // проверка имён (переменные контекста и присвоенные выше по сценарию).
+        // Возвращает ошибки с номерами строк сценария; контекст не меняется.
+        std::vector<Diagnostic> validateScript(const std::string& script) const;
+
+        // Прогоняет сценарий для каждого набора привязок поверх текущего контекста
+        // (сам контекст не меняется). Сценарий разбирается один раз; строки, не зависящие
+        // от привязанных переменных, вычисляются один раз и их значения разделяются всеми
+        // прогонами. Прогоны распределяются по общему пулу потоков (см. setParallelOptions),
+        // лимит памяти действует на каждый прогон отдельно.
+        std::vector<BatchResult> executeBatch(const std::string& script, const std::vector<Bindings>& runs) const;
+
+        // Объединяет одинаковые значения переменных (см. Context::intern).
+        size_t internValues();
+
+        // Чтение из других потоков. Снимок — неизменяемая версия контекста: писатель
+        // (executeLine и т.п., один поток, владеющий интерпретатором) собирает её при каждом
+        // изменении и публикует атомарной заменой указателя, читатель только загружает
+        // указатель — без блокировок и копирования. Версия состоит из неизменяемых слоёв,
+        // связанных через base, поэтому переменные снимка ищутся через find().
+        std::shared_ptr<const Context> snapshot() const;
+        uint64_t version() const;
+
+        // Вычисляет строку по текущему снимку; можно вызывать из любого потока одновременно
+        // с писателем. Присваивания видны только внутри вызова. Лимит памяти, режим и
+        // настройки потоков берутся у этого интерпретатора на момент вызова.
+        LineResult evaluate(const std::string& line) const;
+
+        // Лимит памяти в байтах (0 — без лимита): собственные переменные контекста плюс
+        // результаты операций текущей строки. Операция, чей результат (по оценке) не
+        // помещается в лимит, завершается EvalError до выделения памяти.
+        void setMemoryLimit(size_t bytes) { m_memLimit = bytes; syncReaderSettings(); }
+        size_t memoryLimit() const { return m_memLimit; }
+
+        // Режим вычислений (по умолчанию точный); в сценарии — строки "mode fast" / "mode exact".
+        // В быстром режиме числа, переменные и литералы читаются как double, векторы и матрицы —
+        // упакованными (complex<double> подряд), и операции идут по неточным ядрам; результаты
+        // печатаются десятичными дробями. Уже сохранённые значения не меняются.
+        void setNumericMode(NumericMode mode) { m_mode = mode; syncReaderSettings(); }
+        NumericMode numericMode() const { return m_mode; }
+
+        // Распараллеливание операций этого интерпретатора на общем пуле потоков;
+        // threads = 1 — однопоточный детерминированный режим (см. ParallelOptions).
+        void setParallelOptions(const ParallelOptions& opts) { m_parallel = opts; syncReaderSettings(); }
+        const ParallelOptions& parallelOptions() const { return m_parallel; }
+
+        // Отмена из другого потока или обработчика сигнала (например, по Ctrl-C): текущая
+        // строка завершается CancelledError, контекст не меняется. Токен остаётся взведённым
+        // (и отменяет следующие строки), пока его не сбросят reset().
+        CancelToken& cancelToken() { return *m_cancel; }
+
+        // Лимиты времени: строка, превысившая свой или остаток лимита сессии, завершается
+        // CancelledError. Установка лимитов обнуляет учтённое время сессии.
+        void setTimeLimits(const TimeLimits& limits) { m_time = limits; m_sessionUsed = {}; syncReaderSettings(); }
+        const TimeLimits& timeLimits() const { return m_time; }
+        // Лимит сессии исчерпан: каждая следующая строка сразу завершится CancelledError.
+        bool sessionTimeExhausted() const { return m_time.session.count() && m_sessionUsed >= m_time.session; }
+
+        // Память собственных переменных (без base): общие размещения учитываются один раз.
+        size_t contextBytes() const;
+        // Собственные переменные по убыванию занимаемой памяти.
+        std::vector<std::pair<std::string, size_t>> memoryUsage() const;
+
         // Доступ к контексту (например, для тестов)
         const Context& ctx() const { return m_ctx; }
 
     private:
-        // Parser
-        ValuePtr parseExpr(Tokenizer& tz);
-        ValuePtr parseTerm(Tokenizer& tz);
-        ValuePtr parseFactor(Tokenizer& tz);
+        // Вычисление без исключений, как в Parser: при ошибке функции возвращают nullptr
+        // (run — false), первая ошибка хранится в m_error. Исключениями приходят только
+        // отмена внутри ядер и редкие ошибки, которые видны лишь по ходу операции.
+        bool run(const Statement& st, std::optional<ValuePtr>& out);
+        ValuePtr fail(const Node& at, ErrorCode code, std::string message);
+        ValuePtr eval(const Node& n);
+        ValuePtr evalNode(const Node& n);
+        ValuePtr evalMatrixLiteral(const Node& n);
+        ValuePtr evalProduct(const Node& n);
+        ValuePtr multiply(const ValuePtr& a, const ValuePtr& b, const Node& at);
+        bool reserveBytes(size_t bytes, const Node& at);
+        // Внутренний интерпретатор (читатель evaluate, прогоны executeBatch): снимков
+        // никто не запрашивает, поэтому присваивания их не публикуют.
+        struct Unpublished {};
+        Interpreter(std::shared_ptr<const Context> base, Unpublished);
 
-        ValuePtr parsePrimary(Tokenizer& tz);
-        ValuePtr parseVectorOrMatrix(Tokenizer& tz);
-        ValuePtr parseFunctionCall(Tokenizer& tz, const std::string& name);
+        void assign(const std::string& name, ValuePtr v);
+        void syncReaderSettings();
+        void publishContext(const std::string* changed);
 
-        ValuePtr parseNumber(const Token& tok);
+        // Настройки, с которыми evaluate() вычисляет по снимку.
+        struct ReaderSettings {
+            size_t memLimit{ 0 };
+            ParallelOptions parallel;
+            NumericMode mode{ NumericMode::Exact };
+            std::chrono::milliseconds lineLimit{ 0 };
+        };
 
-        void expect(Tokenizer& tz, TokType t, const char* msg);
+        // Общее с читателями: неизменяемая пара (снимок, настройки). Писатель заменяет её
+        // целиком через std::atomic_store, читатели берут через std::atomic_load.
+        struct Published {
+            std::shared_ptr<const Context> ctx;
+            ReaderSettings settings;
+        };
 
         Context m_ctx;
+        std::shared_ptr<const Published> m_published;
+        // Только у писателя: слои опубликованной версии, снизу вверх; размер каждого
+        // больше размера следующего (как разряды двоичного счётчика).
+        std::vector<std::shared_ptr<const Context>> m_pubLayers;
+        bool m_publish{ true };
+        std::vector<ValuePtr> m_memo; // значения общих подвыражений текущей строки
+        std::optional<Diagnostic> m_error;
+        size_t m_memLimit{ 0 };
+        size_t m_memUsed{ 0 };        // учтено в текущей строке (контекст + результаты)
+        ParallelOptions m_parallel;
+        NumericMode m_mode{ NumericMode::Exact };
+        std::shared_ptr<CancelToken> m_cancel{ std::make_shared<CancelToken>() }; // общий у копий
+        TimeLimits m_time;
+        std::chrono::nanoseconds m_sessionUsed{ 0 };
     };
 
 } // namespace mathcore
@@ -0,0 +1,15 @@
+﻿#pragma once
+#include "MathCore/Value.h"
+
+namespace mathcore {
+
+    // Линейная алгебра над квадратными матрицами. Разложение LU, ранг, определитель
+    // и классификация (диагональная и т.п.) кэшируются в самой MatrixValue, поэтому
+    // повторные det/inv/solve с той же матрицей не раскладывают её заново.
+
+    ValuePtr matrixDet(const Value& m);
+    ValuePtr matrixInverse(const Value& m);
+    ValuePtr matrixSolve(const Value& a, const Value& b);  // b — вектор или матрица правых частей (по столбцам)
+    ValuePtr matrixRank(const Value& m);
+
+} // namespace mathcore
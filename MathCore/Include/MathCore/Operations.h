@@ -0,0 +1,48 @@
+﻿#pragma once
+#include "MathCore/Value.h"
+#include "MathCore/Tokenizer.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mathcore {
+
+    // Общие правила применения операций: используются и вычислителем,
+    // и оптимизатором при свёртке констант, чтобы семантика совпадала.
+
+    // op: Plus / Minus / Star / Slash / Caret / DotStar / DotSlash.
+    ValuePtr binaryOp(TokType op, const Value& left, const Value& right);
+
+    // Проверка binaryOp до выполнения, без исключений: текст ошибки, которую сообщила бы
+    // операция (неподходящие виды операндов, размеры, деление на нулевой скаляр), или nullptr.
+    // Ошибки, видные только по ходу вычисления (переполнение, ноль среди элементов
+    // делителя), операция по-прежнему сообщает через EvalError.
+    const char* checkBinaryOp(TokType op, const Value& left, const Value& right);
+
+    ValuePtr negate(const Value& v);
+
+    // Встроенные функции без побочных эффектов.
+    bool isBuiltinFunction(const std::string& name);
+    ValuePtr callBuiltin(const std::string& name, const std::vector<ValuePtr>& args);
+    // Проверка вызова до выполнения (имя и число аргументов): текст ошибки callBuiltin или nullopt.
+    std::optional<std::string> checkBuiltinCall(const std::string& name, size_t argCount);
+
+    // Функции файлов: open("путь") открывает матрицу на диске, save(M, "путь") записывает
+    // матрицу в файл. Путь — строковый литерал, поэтому вычислитель передаёт пути (paths)
+    // отдельно от вычисленных аргументов (args). Оптимизатор такие вызовы не сворачивает.
+    bool isFileFunction(const std::string& name);
+    ValuePtr callFileFunction(const std::string& name, const std::vector<ValuePtr>& args,
+        const std::vector<std::string>& paths);
+
+    // Оценка сверху памяти под результат (в байтах, как Value::footprint) — до выполнения
+    // операции; по ней вычислитель проверяет лимит памяти. Для ошибочных операндов
+    // оценка произвольна: ошибку сообщит сама операция.
+    size_t estimateBinaryBytes(TokType op, const Value& left, const Value& right);
+    size_t estimateNegateBytes(const Value& v);
+    size_t estimateCallBytes(const std::string& name, const std::vector<ValuePtr>& args);
+
+    // Вектор (одна строка) или матрица из строк скалярных значений.
+    ValuePtr makeMatrixLiteral(std::vector<std::vector<ValuePtr>> rows);
+
+} // namespace mathcore
@@ -0,0 +1,16 @@
+﻿#pragma once
+#include "MathCore/Ast.h"
+
+namespace mathcore {
+
+    // Оптимизация дерева одной строки перед вычислением:
+    //  - свёртка константных подвыражений и литералов векторов/матриц из констант;
+    //  - объединение одинаковых подвыражений: повторы становятся одним узлом
+    //    с ячейкой кэша (Node::slot), и вычисляются один раз за строку.
+    // Не зависит от контекста переменных. Ошибка при свёртке (например, 1/0) не
+    // сообщается: узел остаётся как есть, и ошибка возникнет при вычислении.
+    // mode — режим, в котором строка будет вычислена: в режиме fast константы
+    // сворачиваются неточной арифметикой, как их посчитал бы вычислитель.
+    void optimize(Statement& st, NumericMode mode = NumericMode::Exact);
+
+} // namespace mathcore
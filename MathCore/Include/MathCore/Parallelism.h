@@ -0,0 +1,24 @@
+﻿#pragma once
+#include <cstddef>
+
+namespace mathcore {
+
+    // Распараллеливание операций над векторами и матрицами. Все операции делят один
+    // пул рабочих потоков; разбиение задачи на куски не зависит от числа потоков,
+    // поэтому результаты одинаковы при любых настройках.
+    struct ParallelOptions {
+        // Сколько потоков (вместе с вызывающим) может занять одна операция: 0 — весь пул,
+        // 1 — всё в вызывающем потоке по порядку (детерминированный режим для тестов и отладки:
+        // из нескольких ошибочных кусков сообщается о первом).
+        unsigned threads{ 0 };
+        // Размер результата (в элементах), с которого операция делится между потоками;
+        // 0 — пороги ядер по умолчанию.
+        size_t grain{ 0 };
+    };
+
+    // Размер общего пула вместе с вызывающим потоком (0 — по числу аппаратных потоков).
+    // Пул пересоздаётся, поэтому вызывать, пока нет вычислений (например, при запуске).
+    void setThreadPoolSize(unsigned threads);
+    unsigned threadPoolSize();
+
+} // namespace mathcore
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include "MathCore/Ast.h"
+#include "MathCore/Errors.h"
+#include "MathCore/Tokenizer.h"
+
+#include <optional>
+#include <string>
+
+namespace mathcore {
+
+    struct ParseResult {
+        Statement stmt;
+        std::optional<Diagnostic> error;
+        bool ok() const { return !error; }
+    };
+
+    // Разбор строки в дерево без вычисления. Не использует исключения:
+    // первая ошибка возвращается в ParseResult::error.
+    class Parser {
+    public:
+        static ParseResult parseLine(const std::string& line);
+
+    private:
+        explicit Parser(Tokenizer& tz) : m_tz(tz) {}
+
+        NodePtr parseExpr();
+        NodePtr parseTerm();
+        NodePtr parseFactor();
+        NodePtr parsePower();
+        NodePtr parsePrimary();
+        NodePtr parseVectorOrMatrix(const Token& open);
+        NodePtr parseFunctionCall(const Token& nameTok);
+        NodePtr parseNumber(const Token& tok);
+
+        bool expect(TokType t, ErrorCode code, const char* msg);
+        NodePtr fail(const Token& at, ErrorCode code, const char* msg);
+
+        Tokenizer& m_tz;
+        std::optional<Diagnostic> m_error;
+    };
+
+} // namespace mathcore
@@ -0,0 +1,20 @@
+﻿#pragma once
+#include "MathCore/Value.h"
+
+namespace mathcore {
+
+    // Свёртки по всем элементам вектора или матрицы; скаляр считается одним элементом.
+    // Рациональные данные суммируются точно по общему знаменателю, с одним
+    // сокращением в конце. Комплексные — попарным суммированием с компенсацией
+    // (Ноймайер) по кускам фиксированного размера, поэтому результат не зависит
+    // от числа потоков.
+
+    ValuePtr reduceSum(const Value& v);
+    ValuePtr reduceMean(const Value& v);
+    ValuePtr reduceMin(const Value& v);                    // только рациональные элементы
+    ValuePtr reduceMax(const Value& v);                    // только рациональные элементы
+    ValuePtr reduceDot(const Value& a, const Value& b);    // sum a[i]*b[i], без сопряжения
+    ValuePtr reduceNorm(const Value& v);                   // евклидова (Фробениуса для матриц)
+    ValuePtr reduceTrace(const Value& m);                  // сумма диагонали квадратной матрицы
+
+} // namespace mathcore
@@ -1,5 +1,8 @@
 ﻿#pragma once
 #include "MathCore/Errors.h"
+#include "MathCore/Value.h"
+#include <algorithm>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -11,8 +14,11 @@ namespace mathcore {
         Number,
         LBracket, RBracket,
         LParen, RParen,
-        Semicolon,
-        Plus, Minus, Star, Slash,
+        Semicolon, Comma,
+        Plus, Minus, Star, Slash, Caret,
+        DotStar, DotSlash,  // поэлементные '.*' и './'
+        Literal,            // числовой литерал '[ ... ]' целиком, уже собранный в value
+        String,             // "...": text без кавычек (пути к файлам)
         Equal
     };
 
@@ -21,6 +27,7 @@ namespace mathcore {
         std::string text;
         int line{ 1 };
         int col{ 1 };
+        ValuePtr value;     // для Literal
     };
 
     class Tokenizer {
@@ -28,16 +35,25 @@ namespace mathcore {
         explicit Tokenizer(std::string src);
 
         const Token& peek() const { return m_tokens[m_pos]; }
+        // Токен через ahead позиций после текущего (End, если поток короче).
+        const Token& peek(size_t ahead) const { return m_tokens[std::min(m_pos + ahead, m_tokens.size() - 1)]; }
         Token next();
         bool match(TokType t);
 
+        // Ошибка лексического разбора (недопустимый символ). Токенизатор не бросает
+        // исключений: при ошибке поток токенов обрывается на End.
+        const std::optional<Diagnostic>& error() const { return m_error; }
+
     private:
         void lex();
         void push(TokType t, std::string text, int line, int col);
+        bool isElementwiseOp(size_t i) const;  // с позиции i начинается '.*' или './'
+        bool scanNumericLiteral(size_t& i, int line, int& col);
 
         std::string m_src;
         std::vector<Token> m_tokens;
         size_t m_pos{ 0 };
+        std::optional<Diagnostic> m_error;
     };
 
 } // namespace mathcore
@@ -1,10 +1,13 @@
 ﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
 namespace mathcore {
 
-    enum class ValueKind { Rational, Complex, Vector, Matrix };
+    enum class ValueKind { Rational, Complex, Vector, Matrix, DiskMatrix };
 
     class Value;
     using ValuePtr = std::shared_ptr<Value>;
@@ -21,7 +24,35 @@ namespace mathcore {
         virtual ValuePtr sub(const Value& rhs) const;
         virtual ValuePtr mul(const Value& rhs) const;
         virtual ValuePtr div(const Value& rhs) const;
+        virtual ValuePtr emul(const Value& rhs) const;  // поэлементное '.*'
+        virtual ValuePtr ediv(const Value& rhs) const;  // поэлементное './'
+        virtual ValuePtr neg() const;       // унарный минус
+        virtual ValuePtr pow(const Value& exponent) const;
         virtual ValuePtr transpose() const; // для матриц
+
+        // Структурный хеш: у равных (equals) значений он совпадает. Считается
+        // при первом обращении и кэшируется в объекте.
+        size_t hash() const;
+        // Структурное равенство: сначала вид и хеш (O(1) после первого вызова hash),
+        // затем проверка содержимого.
+        bool equals(const Value& other) const;
+
+        // Добавляет v к хешу seed (для computeHash).
+        static size_t mixHash(size_t seed, uint64_t v);
+
+        // Занимаемая память в байтах: сам объект с блоком управления make_shared и
+        // принадлежащие ему буферы, включая упакованные элементы и уже посчитанные кэши.
+        virtual size_t footprint() const = 0;
+
+        // Блок управления shared_ptr при make_shared: указатель на vtable и два счётчика.
+        static constexpr size_t kSharedControlBlock = sizeof(void*) + 2 * sizeof(int);
+
+    protected:
+        virtual size_t computeHash() const = 0;
+        virtual bool sameContent(const Value& other) const = 0; // other того же вида
+
+    private:
+        mutable std::atomic<size_t> m_hash{ 0 }; // 0 — ещё не посчитан
     };
 
 } // namespace mathcore
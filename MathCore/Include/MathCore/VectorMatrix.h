@@ -4,6 +4,10 @@
 #include "MathCore/RationalValue.h"
 #include "MathCore/ComplexValue.h"
 
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -12,48 +16,152 @@ namespace mathcore {
 
     inline bool isScalar(ValueKind k) { return k == ValueKind::Rational || k == ValueKind::Complex; }
 
-    inline ValuePtr scalarMul(const Value& a, const Value& b) { return a.mul(b); }
-    inline ValuePtr scalarDiv(const Value& a, const Value& b) { return a.div(b); }
-    inline ValuePtr scalarAdd(const Value& a, const Value& b) { return a.add(b); }
-    inline ValuePtr scalarSub(const Value& a, const Value& b) { return a.sub(b); }
+    // Арифметика скаляров (рациональных и комплексных в любом сочетании) без виртуальных
+    // вызовов и промежуточных значений; те же ядра стоят в таблице binaryOp (Operations.cpp).
+    ValuePtr scalarMul(const Value& a, const Value& b);
+    ValuePtr scalarDiv(const Value& a, const Value& b);
+    ValuePtr scalarAdd(const Value& a, const Value& b);
+    ValuePtr scalarSub(const Value& a, const Value& b);
+
+    enum class ElemOp { Add, Sub, Mul, Div };
+
+    // Поэлементная операция с расширением (broadcasting) по правилу «размеры равны
+    // или один из них равен 1»: скаляр расширяется на всё значение, вектор
+    // (строка 1xN) — на каждую строку матрицы, столбец Nx1 — на каждый столбец.
+    // Результат — матрица, если хотя бы один операнд матрица, иначе вектор (или скаляр).
+    // shapeError — текст ошибки при несовместимых размерах.
+    ValuePtr elementwise(ElemOp op, const Value& a, const Value& b, const char* shapeError);
+
+    // Неточное значение для режима fast: рациональные числа становятся double, векторы
+    // и матрицы — упакованными (элементы complex<double> подряд). Остальное без изменений.
+    ValuePtr toInexact(const ValuePtr& v);
 
     class VectorValue final : public Value {
     public:
         explicit VectorValue(std::vector<ValuePtr> items);
+        // Целочисленный вектор: элементы хранятся как int64, RationalValue создаются лениво.
+        explicit VectorValue(std::vector<int64_t> ints);
+        // Неточный вектор: элементы хранятся подряд как complex<double>, ComplexValue создаются лениво.
+        explicit VectorValue(std::vector<std::complex<double>> packed);
 
         ValueKind kind() const override { return ValueKind::Vector; }
         std::string toString() const override;
 
-        const std::vector<ValuePtr>& items() const { return m_items; }
+        const std::vector<ValuePtr>& items() const;
+        size_t size() const { return m_size; }
+
+        // Все элементы — целые (знаменатель 1); ints() тогда содержит их значения.
+        bool isInteger() const { return m_isInt; }
+        const std::vector<int64_t>& ints() const { return m_ints; }
+        // Элементы хранятся подряд как complex<double> (режим fast); packed() содержит их.
+        bool isPacked() const { return m_isPacked; }
+        const std::vector<std::complex<double>>& packed() const { return m_packed; }
 
         ValuePtr add(const Value& rhs) const override;
         ValuePtr sub(const Value& rhs) const override;
         ValuePtr mul(const Value& rhs) const override; // * scalar
         ValuePtr div(const Value& rhs) const override; // / scalar
+        ValuePtr neg() const override;
+
+        size_t footprint() const override;
+        // Оценка сверху для будущего результата из n элементов (до его выделения).
+        static size_t estimateFootprint(size_t n, bool integer);
+        // То же для результата, хранящего элементы подряд как complex<double>.
+        static size_t estimatePackedFootprint(size_t n);
+
+    protected:
+        size_t computeHash() const override;
+        bool sameContent(const Value& other) const override;
 
     private:
-        std::vector<ValuePtr> m_items;
+        mutable std::vector<ValuePtr> m_items;
+        mutable std::once_flag m_boxOnce;
+        mutable std::atomic<bool> m_lazyBoxed{ false }; // ленивая упаковка завершена
+        bool m_boxed{ true };
+
+        std::vector<int64_t> m_ints;
+        bool m_isInt{ false };
+        std::vector<std::complex<double>> m_packed;
+        bool m_isPacked{ false };
+        size_t m_size{ 0 };
+    };
+
+    // Разложение PA = LU с выбором ведущего элемента в столбце (для любой формы rows x cols).
+    // lu хранит U на и над ведущими элементами и множители L (единичная диагональ
+    // не хранится) под ними; perm[i] — исходный номер i-й строки PA.
+    struct LUFactors {
+        std::vector<std::vector<ValuePtr>> lu;
+        std::vector<size_t> perm;
+        std::vector<size_t> pivotCols;  // столбцы ведущих элементов; их число — ранг
+        bool oddPermutation{ false };
     };
 
     class MatrixValue final : public Value {
     public:
         explicit MatrixValue(std::vector<std::vector<ValuePtr>> rows);
+        // Целочисленная матрица rows x cols, элементы построчно.
+        MatrixValue(size_t rows, size_t cols, std::vector<int64_t> ints);
+        // Неточная матрица rows x cols: элементы complex<double> построчно.
+        MatrixValue(size_t rows, size_t cols, std::vector<std::complex<double>> packed);
 
         ValueKind kind() const override { return ValueKind::Matrix; }
         std::string toString() const override;
 
-        size_t rows() const { return m_rows.size(); }
-        size_t cols() const { return m_rows.empty() ? 0 : m_rows[0].size(); }
-        const std::vector<std::vector<ValuePtr>>& data() const { return m_rows; }
+        size_t rows() const { return m_nRows; }
+        size_t cols() const { return m_nCols; }
+        const std::vector<std::vector<ValuePtr>>& data() const;
+
+        bool isInteger() const { return m_isInt; }
+        const std::vector<int64_t>& ints() const { return m_ints; }
+        bool isPacked() const { return m_isPacked; }
+        const std::vector<std::complex<double>>& packed() const { return m_packed; }
 
         ValuePtr add(const Value& rhs) const override;
         ValuePtr sub(const Value& rhs) const override;
         ValuePtr mul(const Value& rhs) const override; // * scalar / vector / matrix
         ValuePtr div(const Value& rhs) const override; // / scalar
-        ValuePtr transpose() const override;
+        ValuePtr neg() const override;
+        ValuePtr pow(const Value& exponent) const override; // целая степень квадратной матрицы
+        ValuePtr transpose() const override; // кэшируется
+
+        // Производные данные. Значения неизменяемы, поэтому каждое вычисляется не более
+        // одного раза на значение (потокобезопасно) и разделяется всеми операциями.
+        const LUFactors& lu() const;
+        size_t rank() const { return lu().pivotCols.size(); }
+        ValuePtr det() const;  // для целых матриц — Барейсс в int64, иначе по LU
+        bool isDiagonal() const;
+        bool isSymmetric() const;
+
+        size_t footprint() const override;
+        static size_t estimateFootprint(size_t rows, size_t cols, bool integer);
+        static size_t estimatePackedFootprint(size_t rows, size_t cols);
+
+    protected:
+        size_t computeHash() const override;
+        bool sameContent(const Value& other) const override;
 
     private:
-        std::vector<std::vector<ValuePtr>> m_rows;
+        mutable std::vector<std::vector<ValuePtr>> m_rows;
+        mutable std::once_flag m_boxOnce;
+        mutable std::atomic<bool> m_lazyBoxed{ false };
+        bool m_boxed{ true };
+
+        std::vector<int64_t> m_ints;
+        bool m_isInt{ false };
+        std::vector<std::complex<double>> m_packed;
+        bool m_isPacked{ false };
+        size_t m_nRows{ 0 };
+        size_t m_nCols{ 0 };
+
+        void classify() const;
+
+        mutable std::once_flag m_luOnce, m_detOnce, m_tOnce, m_classOnce;
+        mutable std::unique_ptr<const LUFactors> m_lu;
+        mutable ValuePtr m_det;
+        mutable ValuePtr m_transposed;
+        mutable std::atomic<bool> m_luReady{ false }, m_detReady{ false }, m_tReady{ false };
+        mutable bool m_diagonal{ false };
+        mutable bool m_symmetric{ false };
     };
 
 } // namespace mathcore
@@ -0,0 +1,34 @@
+﻿#include "pch.h"
+#include "Cancel.h"
+
+namespace mathcore {
+namespace cancel {
+
+    namespace {
+        thread_local const Budget* tlBudget = nullptr;
+    }
+
+    const char* Budget::expired() const {
+        if (token && token->cancelled()) return "Вычисление прервано.";
+        if (deadline != Clock::time_point::max() && Clock::now() >= deadline) return deadlineMessage;
+        return nullptr;
+    }
+
+    void Budget::check() const {
+        if (const char* message = expired()) throw CancelledError(message);
+    }
+
+    const Budget* current() {
+        return tlBudget;
+    }
+
+    Scope::Scope(const Budget* budget) : m_prev(tlBudget) {
+        tlBudget = budget;
+    }
+
+    Scope::~Scope() {
+        tlBudget = m_prev;
+    }
+
+} // namespace cancel
+} // namespace mathcore
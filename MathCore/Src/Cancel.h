@@ -0,0 +1,53 @@
+﻿#pragma once
+// Кооперативная отмена: ограничения текущей строки видны ядрам через поток.
+
+#include "MathCore/Cancellation.h"
+#include "MathCore/Errors.h"
+
+#include <chrono>
+
+namespace mathcore {
+namespace cancel {
+
+    using Clock = std::chrono::steady_clock;
+
+    // Ограничения вычисления одной строки.
+    struct Budget {
+        const CancelToken* token{ nullptr };
+        Clock::time_point deadline{ Clock::time_point::max() };
+        const char* deadlineMessage{ "Превышен лимит времени строки." };
+
+        // Сообщение, если строку отменили или её время вышло; иначе nullptr.
+        const char* expired() const;
+        // Бросает CancelledError, если строку отменили или её время вышло.
+        void check() const;
+    };
+
+    // Ограничения текущего потока; nullptr — вычисление без ограничений.
+    const Budget* current();
+
+    // Ставит ограничения потока на время жизни объекта: строка интерпретатора
+    // или кусок параллельного цикла, выполняемый рабочим потоком пула.
+    class Scope {
+    public:
+        explicit Scope(const Budget* budget);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const Budget* m_prev;
+    };
+
+    // Проверка между блоками работы долгих ядер.
+    inline void check() {
+        if (const Budget* b = current()) b->check();
+    }
+
+    // То же без исключения — для интерпретатора, который сообщает ошибки статусом.
+    inline const char* expired() {
+        const Budget* b = current();
+        return b ? b->expired() : nullptr;
+    }
+
+} // namespace cancel
+} // namespace mathcore
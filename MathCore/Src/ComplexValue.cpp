@@ -1,8 +1,10 @@
 ﻿#include "pch.h"
 #include "MathCore/ComplexValue.h"
 #include "MathCore/RationalValue.h"
+#include "MathCore/VectorMatrix.h"
 
 #include <cmath>
+#include <cstring>
 #include <sstream>
 
 namespace mathcore {
@@ -45,36 +47,69 @@ namespace mathcore {
     }
 
     ValuePtr ComplexValue::add(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational || rhs.kind() == ValueKind::Complex) {
-            return create((m_v + asComplex(rhs)).real(), (m_v + asComplex(rhs)).imag());
-        }
+        if (isScalar(rhs.kind())) return scalarAdd(*this, rhs);
+        if (rhs.kind() == ValueKind::Vector || rhs.kind() == ValueKind::Matrix)
+            return elementwise(ElemOp::Add, *this, rhs, "");
         return Value::add(rhs);
     }
 
     ValuePtr ComplexValue::sub(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational || rhs.kind() == ValueKind::Complex) {
-            const auto res = m_v - asComplex(rhs);
-            return create(res.real(), res.imag());
-        }
+        if (isScalar(rhs.kind())) return scalarSub(*this, rhs);
+        if (rhs.kind() == ValueKind::Vector || rhs.kind() == ValueKind::Matrix)
+            return elementwise(ElemOp::Sub, *this, rhs, "");
         return Value::sub(rhs);
     }
 
     ValuePtr ComplexValue::mul(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational || rhs.kind() == ValueKind::Complex) {
-            const auto res = m_v * asComplex(rhs);
-            return create(res.real(), res.imag());
-        }
+        if (isScalar(rhs.kind())) return scalarMul(*this, rhs);
         return Value::mul(rhs);
     }
 
     ValuePtr ComplexValue::div(const Value& rhs) const {
+        if (isScalar(rhs.kind())) return scalarDiv(*this, rhs);
+        return Value::div(rhs);
+    }
+
+    ValuePtr ComplexValue::pow(const Value& rhs) const {
+        if (rhs.kind() == ValueKind::Rational && static_cast<const RationalValue&>(rhs).den() == 1) {
+            // Целый показатель — бинарное возведение (точнее, чем std::pow через exp/log)
+            const int64_t k = static_cast<const RationalValue&>(rhs).num();
+            std::complex<double> base = m_v, res = 1.0;
+            for (uint64_t e = k < 0 ? 0ULL - static_cast<uint64_t>(k) : static_cast<uint64_t>(k); e; e >>= 1) {
+                if (e & 1) res *= base;
+                if (e > 1) base *= base;
+            }
+            if (k < 0) {
+                if (std::abs(res.real()) < 1e-18 && std::abs(res.imag()) < 1e-18) throw EvalError("Деление на ноль.");
+                res = 1.0 / res;
+            }
+            return create(res.real(), res.imag());
+        }
         if (rhs.kind() == ValueKind::Rational || rhs.kind() == ValueKind::Complex) {
-            const auto d = asComplex(rhs);
-            if (std::abs(d.real()) < 1e-18 && std::abs(d.imag()) < 1e-18) throw EvalError("Деление на ноль.");
-            const auto res = m_v / d;
+            const auto res = std::pow(m_v, asComplex(rhs));
             return create(res.real(), res.imag());
         }
-        return Value::div(rhs);
+        return Value::pow(rhs);
+    }
+
+    ValuePtr ComplexValue::neg() const {
+        // 0.0 - x, а не -x: знак нулевых компонент совпадает с результатом 0 - v
+        return create(0.0 - m_v.real(), 0.0 - m_v.imag());
+    }
+
+    static uint64_t doubleBits(double x) {
+        if (x == 0.0) x = 0.0; // -0.0 == 0.0, хеш должен совпадать
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof bits);
+        return bits;
+    }
+
+    size_t ComplexValue::computeHash() const {
+        return mixHash(mixHash(static_cast<size_t>(ValueKind::Complex), doubleBits(m_v.real())), doubleBits(m_v.imag()));
+    }
+
+    bool ComplexValue::sameContent(const Value& other) const {
+        return m_v == static_cast<const ComplexValue&>(other).m_v;
     }
 
 } // namespace mathcore
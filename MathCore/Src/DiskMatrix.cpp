@@ -0,0 +1,372 @@
+﻿#include "pch.h"
+#include "MathCore/DiskMatrix.h"
+#include "MathCore/VectorMatrix.h"
+#include "Cancel.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+
+namespace mathcore {
+
+    namespace {
+
+        using cplx = std::complex<double>;
+
+        constexpr char kMagic[8] = { 'M', 'C', 'T', 'I', 'L', 'E', 'S', '1' };
+
+        // Имя нового временного файла для результата операции.
+        std::string temporaryPath() {
+            static std::atomic<uint64_t> counter{ 0 };
+            static const uint64_t session = std::random_device{}();
+            const auto name = "mathcore-" + std::to_string(session) + "-" + std::to_string(counter++) + ".tiles";
+            return (std::filesystem::temp_directory_path() / name).u8string();
+        }
+
+        cplx scalarOf(const Value& v) {
+            if (v.kind() == ValueKind::Complex) return static_cast<const ComplexValue&>(v).value();
+            auto& r = static_cast<const RationalValue&>(v);
+            return { static_cast<double>(r.num()) / static_cast<double>(r.den()), 0.0 };
+        }
+
+        const DiskMatrixValue& disk(const Value& v) { return static_cast<const DiskMatrixValue&>(v); }
+
+        // Элемент (i, j) матрицы на диске.
+        cplx at(const DiskMatrixValue& m, uint64_t i, uint64_t j) {
+            const uint64_t t = m.tile();
+            return m.tileData(i / t, j / t)[(i % t) * t + j % t];
+        }
+
+        // Заполняет матрицу потоково, тайл за тайлом: fill(ti, tj, out) пишет тайл (ti, tj).
+        // Каждый тайл результата заполняет один поток, после чего тайл вытесняется из памяти.
+        template <class Fill>
+        void fillTiles(const DiskMatrixValue& out, const Fill& fill) {
+            const uint64_t tc = out.tileCols();
+            par::parallelFor(static_cast<size_t>(out.tileRows() * tc), 1, [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k) {
+                    const uint64_t ti = k / tc, tj = k % tc;
+                    fill(ti, tj, out.tileData(ti, tj));
+                    out.dontNeedTile(ti, tj);
+                }
+            });
+        }
+
+        // Матрица в памяти (вектор — строка 1xN или, если column, столбец Nx1) во временном файле.
+        std::shared_ptr<DiskMatrixValue> toDisk(const Value& v, uint64_t tile, bool column) {
+            std::vector<cplx> flat;
+            uint64_t rows = 1, cols = 1;
+            const auto append = [&](const std::vector<ValuePtr>& items) {
+                for (auto& x : items) flat.push_back(scalarOf(*x));
+            };
+            if (v.kind() == ValueKind::Vector) {
+                auto& x = static_cast<const VectorValue&>(v);
+                (column ? rows : cols) = x.size();
+                if (x.isInteger()) flat.assign(x.ints().begin(), x.ints().end());
+                else if (x.isPacked()) flat = x.packed();
+                else append(x.items());
+            }
+            else if (v.kind() == ValueKind::Matrix) {
+                auto& m = static_cast<const MatrixValue&>(v);
+                rows = m.rows();
+                cols = m.cols();
+                if (m.isInteger()) flat.assign(m.ints().begin(), m.ints().end());
+                else if (m.isPacked()) flat = m.packed();
+                else for (auto& r : m.data()) append(r);
+            }
+            else {
+                throw EvalError("Ожидалась матрица или вектор.");
+            }
+
+            auto out = DiskMatrixValue::create(rows, cols, "", tile);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                for (uint64_t r = 0; r < tile && ti * tile + r < rows; ++r)
+                    for (uint64_t c = 0; c < tile && tj * tile + c < cols; ++c)
+                        dst[r * tile + c] = flat[(ti * tile + r) * cols + tj * tile + c];
+            });
+            return out;
+        }
+
+        // Та же матрица с другим размером тайла (операнды двух файлов с разной разбивкой).
+        std::shared_ptr<const DiskMatrixValue> retile(const DiskMatrixValue& m, uint64_t tile,
+            const std::shared_ptr<const DiskMatrixValue>& self) {
+            if (m.tile() == tile) return self;
+            auto out = DiskMatrixValue::create(m.rows(), m.cols(), "", tile);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                for (uint64_t r = 0; r < tile && ti * tile + r < m.rows(); ++r)
+                    for (uint64_t c = 0; c < tile && tj * tile + c < m.cols(); ++c)
+                        dst[r * tile + c] = at(m, ti * tile + r, tj * tile + c);
+            });
+            return out;
+        }
+
+        // Операнд поэлементной операции или произведения в виде матрицы на диске.
+        std::shared_ptr<const DiskMatrixValue> asDisk(const Value& v, uint64_t tile, bool column) {
+            if (v.kind() != ValueKind::DiskMatrix) return toDisk(v, tile, column);
+            auto& m = disk(v);
+            // Значение живёт, пока идёт операция: shared_ptr без владения
+            return retile(m, tile, std::shared_ptr<const DiskMatrixValue>(std::shared_ptr<const DiskMatrixValue>(), &m));
+        }
+
+        ValuePtr mapTiles(const DiskMatrixValue& a, const std::function<cplx(cplx)>& f) {
+            const uint64_t t = a.tile();
+            auto out = DiskMatrixValue::create(a.rows(), a.cols(), "", t);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                const cplx* src = a.tileData(ti, tj);
+                // Дополнение краёв остаётся нулевым: на это рассчитано умножение по тайлам
+                for (uint64_t r = 0; r < t && ti * t + r < a.rows(); ++r)
+                    for (uint64_t c = 0; c < t && tj * t + c < a.cols(); ++c)
+                        dst[r * t + c] = f(src[r * t + c]);
+                a.dontNeedTile(ti, tj);
+            });
+            return out;
+        }
+
+        ValuePtr zipTiles(const DiskMatrixValue& a, const DiskMatrixValue& b, const std::function<cplx(cplx, cplx)>& f) {
+            const uint64_t t = a.tile();
+            auto out = DiskMatrixValue::create(a.rows(), a.cols(), "", t);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                const cplx* x = a.tileData(ti, tj);
+                const cplx* y = b.tileData(ti, tj);
+                for (uint64_t r = 0; r < t && ti * t + r < a.rows(); ++r)
+                    for (uint64_t c = 0; c < t && tj * t + c < a.cols(); ++c)
+                        dst[r * t + c] = f(x[r * t + c], y[r * t + c]);
+                a.dontNeedTile(ti, tj);
+                b.dontNeedTile(ti, tj);
+            });
+            return out;
+        }
+
+        cplx checkedDiv(cplx x, cplx d) {
+            if (std::abs(d.real()) < 1e-18 && std::abs(d.imag()) < 1e-18) throw EvalError("Деление на ноль.");
+            return x / d;
+        }
+
+        // C = A * B по тайлам: тайл C накапливается в файле результата по строке тайлов A
+        // и столбцу тайлов B; следующая пара тайлов заранее запрашивается у ОС (willNeed),
+        // пока считается текущая.
+        ValuePtr multiplyTiles(const DiskMatrixValue& a, const DiskMatrixValue& b) {
+            if (a.cols() != b.rows()) throw EvalError("Нельзя умножить матрицы: A.cols != B.rows.");
+            const uint64_t t = a.tile(), inner = a.tileCols();
+            auto out = DiskMatrixValue::create(a.rows(), b.cols(), "", t);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                for (uint64_t tk = 0; tk < inner; ++tk) {
+                    if (tk + 1 < inner) {
+                        a.willNeedTile(ti, tk + 1);
+                        b.willNeedTile(tk + 1, tj);
+                    }
+                    const cplx* x = a.tileData(ti, tk);
+                    const cplx* y = b.tileData(tk, tj);
+                    for (uint64_t r = 0; r < t; ++r)
+                        for (uint64_t p = 0; p < t; ++p) {
+                            const cplx xp = x[r * t + p];
+                            if (xp == cplx()) continue; // в том числе дополнение нулями
+                            const cplx* yRow = y + p * t;
+                            cplx* dRow = dst + r * t;
+                            for (uint64_t c = 0; c < t; ++c) dRow[c] += xp * yRow[c];
+                        }
+                    cancel::check();
+                }
+            });
+            return out;
+        }
+
+        ValuePtr transposeTiles(const DiskMatrixValue& a) {
+            const uint64_t t = a.tile();
+            auto out = DiskMatrixValue::create(a.cols(), a.rows(), "", t);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                const cplx* src = a.tileData(tj, ti);
+                for (uint64_t r = 0; r < t; ++r)
+                    for (uint64_t c = 0; c < t; ++c) dst[r * t + c] = src[c * t + r];
+                a.dontNeedTile(tj, ti);
+            });
+            return out;
+        }
+
+        bool isMatrixLike(ValueKind k) {
+            return k == ValueKind::Vector || k == ValueKind::Matrix || k == ValueKind::DiskMatrix;
+        }
+
+    } // namespace
+
+    std::shared_ptr<DiskMatrixValue> DiskMatrixValue::create(uint64_t rows, uint64_t cols, const std::string& path,
+        uint64_t tile) {
+        const uint64_t tiles = ((rows + tile - 1) / tile) * ((cols + tile - 1) / tile);
+        const bool temporary = path.empty();
+        auto file = MappedFile::create(temporary ? temporaryPath() : path,
+            kDataOffset + tiles * tile * tile * sizeof(cplx), temporary);
+        TiledHeader h{};
+        std::memcpy(h.magic, kMagic, sizeof kMagic);
+        h.rows = rows;
+        h.cols = cols;
+        h.tile = tile;
+        std::memcpy(file->data(), &h, sizeof h);
+        return std::make_shared<DiskMatrixValue>(std::move(file));
+    }
+
+    std::shared_ptr<DiskMatrixValue> DiskMatrixValue::open(const std::string& path) {
+        if (!std::filesystem::exists(std::filesystem::u8path(path))) throw EvalError("Файл не найден: " + path);
+        return std::make_shared<DiskMatrixValue>(MappedFile::openReadOnly(path));
+    }
+
+    DiskMatrixValue::DiskMatrixValue(std::shared_ptr<MappedFile> file) : m_file(std::move(file)) {
+        TiledHeader h{};
+        const bool hasHeader = m_file->size() >= kDataOffset;
+        if (hasHeader) std::memcpy(&h, m_file->data(), sizeof h);
+        if (!hasHeader || std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 || h.rows == 0 || h.cols == 0 ||
+            h.tile == 0 || h.tile > (uint64_t(1) << 12))
+            throw EvalError("Файл не содержит матрицу: " + m_file->path());
+        m_rows = h.rows;
+        m_cols = h.cols;
+        m_tile = h.tile;
+        // Размер файла проверяется делением, чтобы число тайлов из заголовка не переполнилось
+        const uint64_t available = (m_file->size() - kDataOffset) / tileBytes();
+        if (tileRows() > available || tileCols() > available / tileRows())
+            throw EvalError("Файл матрицы обрезан: " + m_file->path());
+    }
+
+    const std::string& DiskMatrixValue::path() const { return m_file->path(); }
+
+    std::complex<double>* DiskMatrixValue::tileData(uint64_t ti, uint64_t tj) const {
+        auto* base = m_file->data() + kDataOffset + (ti * tileCols() + tj) * tileBytes();
+        return reinterpret_cast<std::complex<double>*>(base);
+    }
+
+    void DiskMatrixValue::willNeedTile(uint64_t ti, uint64_t tj) const {
+        m_file->willNeed(kDataOffset + (ti * tileCols() + tj) * tileBytes(), tileBytes());
+    }
+
+    void DiskMatrixValue::dontNeedTile(uint64_t ti, uint64_t tj) const {
+        m_file->dontNeed(kDataOffset + (ti * tileCols() + tj) * tileBytes(), tileBytes());
+    }
+
+    std::string DiskMatrixValue::toString() const {
+        return "<матрица " + std::to_string(m_rows) + "x" + std::to_string(m_cols) + " на диске: " + path() + ">";
+    }
+
+    ValuePtr DiskMatrixValue::add(const Value& rhs) const { return diskBinaryOp(TokType::Plus, *this, rhs); }
+    ValuePtr DiskMatrixValue::sub(const Value& rhs) const { return diskBinaryOp(TokType::Minus, *this, rhs); }
+    ValuePtr DiskMatrixValue::mul(const Value& rhs) const { return diskBinaryOp(TokType::Star, *this, rhs); }
+    ValuePtr DiskMatrixValue::div(const Value& rhs) const { return diskBinaryOp(TokType::Slash, *this, rhs); }
+    ValuePtr DiskMatrixValue::emul(const Value& rhs) const { return diskBinaryOp(TokType::DotStar, *this, rhs); }
+    ValuePtr DiskMatrixValue::ediv(const Value& rhs) const { return diskBinaryOp(TokType::DotSlash, *this, rhs); }
+
+    ValuePtr DiskMatrixValue::neg() const {
+        return mapTiles(*this, [](cplx x) { return cplx(0.0 - x.real(), 0.0 - x.imag()); });
+    }
+
+    ValuePtr DiskMatrixValue::transpose() const {
+        return transposeTiles(*this);
+    }
+
+    size_t DiskMatrixValue::computeHash() const {
+        // Содержимое не читается: равными считаются только значения одного файла.
+        return mixHash(static_cast<size_t>(ValueKind::DiskMatrix), std::hash<std::string>{}(path()));
+    }
+
+    bool DiskMatrixValue::sameContent(const Value& other) const {
+        return path() == disk(other).path();
+    }
+
+    ValuePtr diskBinaryOp(TokType op, const Value& left, const Value& right) {
+        const bool lScalar = isScalar(left.kind()), rScalar = isScalar(right.kind());
+        if ((!lScalar && !isMatrixLike(left.kind())) || (!rScalar && !isMatrixLike(right.kind())))
+            throw EvalError("Ожидалась матрица или скаляр.");
+        const uint64_t tile = left.kind() == ValueKind::DiskMatrix ? disk(left).tile() : disk(right).tile();
+
+        std::function<cplx(cplx, cplx)> f;
+        switch (op) {
+        case TokType::Plus: f = [](cplx x, cplx y) { return x + y; }; break;
+        case TokType::Minus: f = [](cplx x, cplx y) { return x - y; }; break;
+        case TokType::Star:
+        case TokType::DotStar: f = [](cplx x, cplx y) { return x * y; }; break;
+        case TokType::Slash:
+            if (!rScalar) throw EvalError("Матрицу на диске можно делить только на скаляр.");
+            f = checkedDiv;
+            break;
+        case TokType::DotSlash: f = checkedDiv; break;
+        default:
+            throw EvalError("Операция не поддерживается для матриц на диске.");
+        }
+
+        if (lScalar) {
+            const cplx s = scalarOf(left);
+            return mapTiles(disk(right), [&](cplx y) { return f(s, y); });
+        }
+        if (rScalar) {
+            const cplx s = scalarOf(right);
+            return mapTiles(disk(left), [&](cplx x) { return f(x, s); });
+        }
+
+        const auto a = asDisk(left, tile, false);
+        if (op == TokType::Star) return multiplyTiles(*a, *asDisk(right, tile, true));
+        const auto b = asDisk(right, tile, false);
+        if (a->rows() != b->rows() || a->cols() != b->cols()) throw EvalError("Размеры матриц не совпадают.");
+        return zipTiles(*a, *b, f);
+    }
+
+    ValuePtr saveDiskMatrix(const Value& m, const std::string& path) {
+        const uint64_t tile = m.kind() == ValueKind::DiskMatrix ? disk(m).tile() : DiskMatrixValue::kDefaultTile;
+        // Сначала во временный файл рядом с целевым, затем переименование: уже открытая
+        // матрица с тем же путём продолжает видеть свои прежние данные.
+        const auto target = std::filesystem::u8path(path);
+        const std::string staging = path + ".tmp";
+        std::error_code ec;
+        try {
+            const auto src = asDisk(m, tile, false);
+            auto out = DiskMatrixValue::create(src->rows(), src->cols(), staging, tile);
+            fillTiles(*out, [&](uint64_t ti, uint64_t tj, cplx* dst) {
+                std::memcpy(dst, src->tileData(ti, tj), static_cast<size_t>(tile * tile * sizeof(cplx)));
+                src->dontNeedTile(ti, tj);
+            });
+        }
+        catch (...) {
+            std::filesystem::remove(std::filesystem::u8path(staging), ec);
+            throw;
+        }
+        std::filesystem::rename(std::filesystem::u8path(staging), target, ec);
+        if (ec) {
+            std::filesystem::remove(std::filesystem::u8path(staging), ec);
+            throw EvalError("Не удалось сохранить файл: " + path);
+        }
+        return DiskMatrixValue::open(path);
+    }
+
+    ValuePtr loadDiskMatrix(const Value& v) {
+        if (v.kind() != ValueKind::DiskMatrix) throw EvalError("Функция load ожидает матрицу на диске.");
+        auto& m = disk(v);
+        const size_t rows = static_cast<size_t>(m.rows()), cols = static_cast<size_t>(m.cols());
+
+        std::vector<cplx> flat(rows * cols);
+        bool integer = true;
+        for (size_t i = 0; i < rows; ++i)
+            for (size_t j = 0; j < cols; ++j) {
+                const cplx x = at(m, i, j);
+                flat[i * cols + j] = x;
+                integer = integer && x.imag() == 0.0 && std::trunc(x.real()) == x.real() && std::abs(x.real()) < 9.0e15;
+            }
+
+        if (integer) {
+            std::vector<int64_t> ints(flat.size());
+            for (size_t k = 0; k < flat.size(); ++k) ints[k] = static_cast<int64_t>(flat[k].real());
+            if (rows == 1) return std::make_shared<VectorValue>(std::move(ints));
+            return std::make_shared<MatrixValue>(rows, cols, std::move(ints));
+        }
+
+        std::vector<std::vector<ValuePtr>> data(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            data[i].reserve(cols);
+            for (size_t j = 0; j < cols; ++j) {
+                const cplx x = flat[i * cols + j];
+                data[i].push_back(ComplexValue::create(x.real(), x.imag()));
+            }
+        }
+        if (rows == 1) return std::make_shared<VectorValue>(std::move(data[0]));
+        return std::make_shared<MatrixValue>(std::move(data));
+    }
+
+} // namespace mathcore
@@ -0,0 +1,183 @@
+﻿#pragma once
+// Внутренние int64-ядра для целочисленных векторов и матриц (все знаменатели равны 1).
+// Каждое ядро возвращает false при переполнении: вызывающий код тогда
+// откатывается на точный рациональный путь.
+
+#include <cstddef>
+#include <cstdint>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace mathcore {
+namespace intk {
+
+    // Модуль без UB для INT64_MIN.
+    inline uint64_t magnitude(int64_t x) {
+        return x < 0 ? (static_cast<uint64_t>(-(x + 1)) + 1ULL) : static_cast<uint64_t>(x);
+    }
+
+    // Число значащих бит.
+    inline unsigned bitWidth(uint64_t x) {
+        unsigned w = 0;
+        while (x) { ++w; x >>= 1; }
+        return w;
+    }
+
+    inline uint64_t maxMagnitude(const int64_t* p, size_t n) {
+        uint64_t m = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t a = magnitude(p[i]);
+            m = a > m ? a : m;
+        }
+        return m;
+    }
+
+    // Число младших нулевых бит (x != 0).
+    inline unsigned trailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctzll(x));
+#elif defined(_M_X64) || defined(_M_ARM64)
+        unsigned long i;
+        _BitScanForward64(&i, x);
+        return static_cast<unsigned>(i);
+#else
+        unsigned n = 0;
+        while (!(x & 1)) { x >>= 1; ++n; }
+        return n;
+#endif
+    }
+
+    // Бинарный НОД (Штейн): только сдвиги и вычитания, без деления.
+    inline uint64_t gcd(uint64_t a, uint64_t b) {
+        if (a == 0) return b;
+        if (b == 0) return a;
+        const unsigned shift = trailingZeros(a | b);
+        a >>= trailingZeros(a);
+        do {
+            b >>= trailingZeros(b);
+            if (a > b) { const uint64_t t = a; a = b; b = t; }
+            b -= a;
+        } while (b != 0);
+        return a << shift;
+    }
+
+    inline bool mulChecked(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_mul_overflow(a, b, &out);
+#else
+        if (a == 0 || b == 0) { out = 0; return true; }
+        const uint64_t ua = magnitude(a), ub = magnitude(b);
+        const bool neg = (a < 0) != (b < 0);
+        const uint64_t limit = neg ? (1ULL << 63) : static_cast<uint64_t>(INT64_MAX);
+        if (ua > limit / ub) return false;
+        const uint64_t p = ua * ub;
+        out = neg ? static_cast<int64_t>(0ULL - p) : static_cast<int64_t>(p);
+        return true;
+#endif
+    }
+
+    inline bool addChecked(int64_t a, int64_t b, int64_t& out) {
+        const uint64_t r = static_cast<uint64_t>(a) + static_cast<uint64_t>(b);
+        out = static_cast<int64_t>(r);
+        return (((static_cast<uint64_t>(a) ^ r) & (static_cast<uint64_t>(b) ^ r)) >> 63) == 0;
+    }
+
+    inline bool subChecked(int64_t a, int64_t b, int64_t& out) {
+        const uint64_t r = static_cast<uint64_t>(a) - static_cast<uint64_t>(b);
+        out = static_cast<int64_t>(r);
+        return (((static_cast<uint64_t>(a) ^ static_cast<uint64_t>(b)) & (static_cast<uint64_t>(a) ^ r)) >> 63) == 0;
+    }
+
+    // Десятичная запись [цифры] ['.' [цифры]] как num / den, где den = 10^(цифр после точки).
+    // false — посторонний символ или num, den не помещаются в int64.
+    inline bool parseDecimal(const char* s, size_t n, int64_t& num, int64_t& den) {
+        num = 0;
+        den = 1;
+        bool dot = false;
+        for (size_t i = 0; i < n; ++i) {
+            const char c = s[i];
+            if (c == '.' && !dot) { dot = true; continue; }
+            if (c < '0' || c > '9') return false;
+            const int d = c - '0';
+            if (num > (INT64_MAX - d) / 10) return false;
+            num = num * 10 + d;
+            if (dot) {
+                if (den > INT64_MAX / 10) return false;
+                den *= 10;
+            }
+        }
+        return true;
+    }
+
+    // out = a + b (или a - b при negateB). Флаг переполнения собирается без ветвлений,
+    // поэтому цикл векторизуется.
+    inline bool addSub(const int64_t* a, const int64_t* b, int64_t* out, size_t n, bool negateB) {
+        uint64_t ovf = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t x = static_cast<uint64_t>(a[i]);
+            const uint64_t y = static_cast<uint64_t>(b[i]);
+            const uint64_t r = negateB ? x - y : x + y;
+            out[i] = static_cast<int64_t>(r);
+            ovf |= negateB ? ((x ^ y) & (x ^ r)) : ((x ^ r) & (y ^ r));
+        }
+        return (ovf >> 63) == 0;
+    }
+
+    // out = -a
+    inline bool negate(const int64_t* a, int64_t* out, size_t n) {
+        uint64_t ovf = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t x = static_cast<uint64_t>(a[i]);
+            const uint64_t r = 0ULL - x;
+            out[i] = static_cast<int64_t>(r);
+            ovf |= x & r; // только INT64_MIN остаётся отрицательным после смены знака
+        }
+        return (ovf >> 63) == 0;
+    }
+
+    // out = a * s
+    inline bool scale(const int64_t* a, int64_t s, int64_t* out, size_t n) {
+        if (bitWidth(maxMagnitude(a, n)) + bitWidth(magnitude(s)) < 63) {
+            for (size_t i = 0; i < n; ++i) out[i] = a[i] * s;
+            return true;
+        }
+        for (size_t i = 0; i < n; ++i)
+            if (!mulChecked(a[i], s, out[i])) return false;
+        return true;
+    }
+
+    // out(n x p) = a(n x m) * b(m x p), всё построчно. Если оценка по модулям
+    // гарантирует отсутствие переполнения, работает простой i-k-j цикл без проверок
+    // (векторизуемый); иначе — поэлементно проверяемый вариант.
+    inline bool matMul(const int64_t* a, const int64_t* b, int64_t* out, size_t n, size_t m, size_t p) {
+        const unsigned bound = bitWidth(maxMagnitude(a, n * m)) + bitWidth(maxMagnitude(b, m * p)) + bitWidth(m);
+        if (bound < 63) {
+            for (size_t i = 0; i < n * p; ++i) out[i] = 0;
+            for (size_t i = 0; i < n; ++i) {
+                int64_t* row = out + i * p;
+                for (size_t k = 0; k < m; ++k) {
+                    const int64_t aik = a[i * m + k];
+                    const int64_t* bk = b + k * p;
+                    for (size_t j = 0; j < p; ++j) row[j] += aik * bk[j];
+                }
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < p; ++j) {
+                int64_t acc = 0;
+                for (size_t k = 0; k < m; ++k) {
+                    int64_t prod;
+                    if (!mulChecked(a[i * m + k], b[k * p + j], prod)) return false;
+                    if (!addChecked(acc, prod, acc)) return false;
+                }
+                out[i * p + j] = acc;
+            }
+        }
+        return true;
+    }
+
+} // namespace intk
+} // namespace mathcore
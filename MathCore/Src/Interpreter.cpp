@@ -1,240 +1,650 @@
 ﻿#include "pch.h"
 #include "MathCore/Interpreter.h"
+#include "MathCore/Operations.h"
+#include "MathCore/Optimizer.h"
+#include "Cancel.h"
+#include "Parallel.h"
 
-#include <cctype>
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace mathcore {
 
-    Interpreter::Interpreter() {
+    const ValuePtr* Context::find(const std::string& name) const {
+        for (const Context* c = this; c; c = c->base.get()) {
+            auto it = c->vars.find(name);
+            if (it != c->vars.end()) return &it->second;
+        }
+        return nullptr;
+    }
+
+    size_t Context::intern() {
+        // Уже встреченные значения по хешу; значения base служат только образцами.
+        std::unordered_multimap<size_t, ValuePtr> seen;
+        const auto lookup = [&](const ValuePtr& v) -> const ValuePtr* {
+            auto range = seen.equal_range(v->hash());
+            for (auto it = range.first; it != range.second; ++it)
+                if (it->second->equals(*v)) return &it->second;
+            return nullptr;
+        };
+
+        for (const Context* c = base.get(); c; c = c->base.get())
+            for (auto& kv : c->vars)
+                if (!lookup(kv.second)) seen.emplace(kv.second->hash(), kv.second);
+
+        size_t replaced = 0;
+        for (auto& kv : vars) {
+            if (auto same = lookup(kv.second)) {
+                if (same->get() != kv.second.get()) {
+                    kv.second = *same;
+                    ++replaced;
+                }
+            }
+            else {
+                seen.emplace(kv.second->hash(), kv.second);
+            }
+        }
+        return replaced;
+    }
+
+    Interpreter::Interpreter() : Interpreter(nullptr) {}
+
+    Interpreter::Interpreter(std::shared_ptr<const Context> base) : Interpreter(std::move(base), Unpublished{}) {
+        m_publish = true;
+        publishContext(nullptr);
+    }
+
+    Interpreter::Interpreter(std::shared_ptr<const Context> base, Unpublished) {
         // Встроенная константа i = 0 + 1i
         m_ctx.vars["i"] = ComplexValue::create(0.0, 1.0);
+        m_ctx.base = std::move(base);
+        ++m_ctx.version;
+        m_publish = false;
     }
 
-    static bool isAssignStart(const Token& t1, const Token& t2) {
-        return t1.type == TokType::Ident && t2.type == TokType::Equal;
+    void Interpreter::assign(const std::string& name, ValuePtr v) {
+        m_ctx.vars[name] = std::move(v);
+        ++m_ctx.version;
+        if (m_publish) publishContext(&name);
     }
 
-    std::optional<ValuePtr> Interpreter::executeLine(const std::string& line) {
-        Tokenizer tz(line);
+    void Interpreter::publishContext(const std::string* changed) {
+        // Новая версия собирается здесь, у писателя. Изменённая переменная становится новым
+        // верхним слоем; пока слой под ним не больше его, они сливаются в один. Каждая
+        // переменная копируется при слиянии O(log n) раз, а поиск проходит O(log n) слоёв.
+        // changed == nullptr — контекст изменился целиком: один слой с полной копией.
+        Context top;
+        if (changed) {
+            top.vars.emplace(*changed, m_ctx.vars.at(*changed));
+            while (!m_pubLayers.empty() && m_pubLayers.back()->vars.size() <= top.vars.size()) {
+                top.vars.insert(m_pubLayers.back()->vars.begin(), m_pubLayers.back()->vars.end());
+                m_pubLayers.pop_back();
+            }
+        }
+        else {
+            m_pubLayers.clear();
+            top.vars = m_ctx.vars;
+        }
+        top.base = m_pubLayers.empty() ? m_ctx.base : m_pubLayers.back();
+        top.version = m_ctx.version;
+        m_pubLayers.push_back(std::make_shared<const Context>(std::move(top)));
+
+        auto pub = std::make_shared<Published>();
+        pub->ctx = m_pubLayers.back();
+        pub->settings = ReaderSettings{ m_memLimit, m_parallel, m_mode, m_time.line };
+        std::atomic_store(&m_published, std::shared_ptr<const Published>(std::move(pub)));
+    }
+
+    void Interpreter::syncReaderSettings() {
+        if (!m_publish) return;
+        auto pub = std::make_shared<Published>(*std::atomic_load(&m_published));
+        pub->settings = ReaderSettings{ m_memLimit, m_parallel, m_mode, m_time.line };
+        std::atomic_store(&m_published, std::shared_ptr<const Published>(std::move(pub)));
+    }
 
-        // Пустая строка
-        if (tz.peek().type == TokType::End) return std::nullopt;
+    std::shared_ptr<const Context> Interpreter::snapshot() const {
+        return std::atomic_load(&m_published)->ctx;
+    }
 
-        // Присваивание: IDENT '=' expr
-        Token t1 = tz.peek();
-        Token t2;
-        {
-            Tokenizer tz2(line);
-            t1 = tz2.next();
-            t2 = tz2.peek();
-        }
+    uint64_t Interpreter::version() const {
+        return snapshot()->version;
+    }
 
-        if (isAssignStart(t1, t2)) {
-            const std::string name = t1.text;
-            tz.next(); // ident
-            tz.next(); // '='
-            auto v = parseExpr(tz);
-            if (tz.peek().type != TokType::End) throw ParseError(tz.peek().line, tz.peek().col, "Лишние токены в конце строки.");
-            m_ctx.vars[name] = v;
-            return std::nullopt;
+    size_t Interpreter::internValues() {
+        const size_t replaced = m_ctx.intern();
+        if (replaced) {
+            ++m_ctx.version;
+            if (m_publish) publishContext(nullptr);
         }
+        return replaced;
+    }
 
-        // Иначе — просто выражение
-        auto v = parseExpr(tz);
-        if (tz.peek().type != TokType::End) throw ParseError(tz.peek().line, tz.peek().col, "Лишние токены в конце строки.");
-        return v;
+    LineResult Interpreter::evaluate(const std::string& line) const {
+        const auto pub = std::atomic_load(&m_published);
+        Interpreter reader(pub->ctx, Unpublished{});
+        reader.m_memLimit = pub->settings.memLimit;
+        reader.m_parallel = pub->settings.parallel;
+        reader.m_mode = pub->settings.mode;
+        reader.m_time.line = pub->settings.lineLimit;
+        return reader.tryExecuteLine(line);
     }
 
-    void Interpreter::expect(Tokenizer& tz, TokType t, const char* msg) {
-        if (!tz.match(t)) {
-            const auto& p = tz.peek();
-            throw ParseError(p.line, p.col, msg);
+    // Проверяет, что все переменные и функции выражения известны. Без исключений.
+    template <class IsDefined>
+    static std::optional<Diagnostic> checkNames(const Node& n, const IsDefined& isDefined) {
+        if (n.kind == NodeKind::Variable && !isDefined(n.name))
+            return Diagnostic{ ErrorCode::UnknownVariable, n.line, n.col, "Неизвестная переменная: " + n.name };
+        if (n.kind == NodeKind::Call && !isBuiltinFunction(n.name) && !isFileFunction(n.name))
+            return Diagnostic{ ErrorCode::UnknownFunction, n.line, n.col, "Неизвестная функция: " + n.name };
+        for (auto& a : n.args) {
+            if (auto d = checkNames(*a, isDefined)) return d;
         }
+        return std::nullopt;
     }
 
-    // expr := term (('+'|'-') term)*
-    ValuePtr Interpreter::parseExpr(Tokenizer& tz) {
-        auto left = parseTerm(tz);
-        while (true) {
-            if (tz.match(TokType::Plus)) {
-                auto right = parseTerm(tz);
-                left = left->add(*right);
-            }
-            else if (tz.match(TokType::Minus)) {
-                auto right = parseTerm(tz);
-                left = left->sub(*right);
-            }
-            else break;
+    // Ошибки, которые ядра находят только по ходу операции (вырожденная матрица в inv,
+    // переполнение) и отмена внутри долгих ядер, приходят исключениями: переводим их
+    // в Diagnostic. Остальные ошибки вычислитель возвращает статусом.
+    template <class F>
+    static std::optional<Diagnostic> guarded(int line, int col, F&& f) {
+        try {
+            f();
+        }
+        catch (const CancelledError& e) {
+            return Diagnostic{ ErrorCode::Cancelled, line, col, e.what() };
         }
-        return left;
+        catch (const std::exception& e) {
+            return Diagnostic{ ErrorCode::Evaluation, line, col, e.what() };
+        }
+        return std::nullopt;
+    }
+
+    std::optional<ValuePtr> Interpreter::executeLine(const std::string& line) {
+        auto parsed = Parser::parseLine(line);
+        if (parsed.error) throw ParseError(*parsed.error);
+        optimize(parsed.stmt, m_mode);
+        return execute(parsed.stmt);
     }
 
-    // term := factor (('*'|'/') factor)*
-    ValuePtr Interpreter::parseTerm(Tokenizer& tz) {
-        auto left = parseFactor(tz);
-        while (true) {
-            if (tz.match(TokType::Star)) {
-                auto right = parseFactor(tz);
+    std::optional<ValuePtr> Interpreter::execute(const Statement& st) {
+        std::optional<ValuePtr> out;
+        if (run(st, out)) return out;
+        if (m_error->code == ErrorCode::Cancelled) throw CancelledError(m_error->message);
+        throw EvalError(m_error->message);
+    }
 
-                // Поддержка Scalar*Vector и Scalar*Matrix
-                if (isScalar(left->kind()) && right->kind() == ValueKind::Vector) {
-                    left = right->mul(*left);
-                }
-                else if (isScalar(left->kind()) && right->kind() == ValueKind::Matrix) {
-                    left = right->mul(*left);
-                }
-                else {
-                    left = left->mul(*right);
-                }
+    bool Interpreter::run(const Statement& st, std::optional<ValuePtr>& out) {
+        m_error.reset();
+        out.reset();
+        if (st.mode && *st.mode != m_mode) {
+            m_mode = *st.mode;
+            syncReaderSettings();
+        }
+        // Пустая строка или директива
+        if (!st.expr) return true;
+
+        // Время строки засчитывается в лимит сессии и при ошибке.
+        struct SessionClock {
+            std::chrono::nanoseconds& used;
+            cancel::Clock::time_point start{ cancel::Clock::now() };
+            ~SessionClock() { used += cancel::Clock::now() - start; }
+        } clock{ m_sessionUsed };
+
+        cancel::Budget budget;
+        budget.token = m_cancel.get();
+        if (m_time.line.count()) budget.deadline = clock.start + m_time.line;
+        if (m_time.session.count()) {
+            const auto left = m_time.session - m_sessionUsed;
+            if (left.count() <= 0) {
+                fail(*st.expr, ErrorCode::Cancelled, "Исчерпан лимит времени сессии.");
+                return false;
             }
-            else if (tz.match(TokType::Slash)) {
-                auto right = parseFactor(tz);
-                left = left->div(*right);
+            if (clock.start + left < budget.deadline) {
+                budget.deadline = clock.start + std::chrono::duration_cast<cancel::Clock::duration>(left);
+                budget.deadlineMessage = "Исчерпан лимит времени сессии.";
             }
-            else break;
         }
-        return left;
+        if (const char* message = budget.expired()) {
+            fail(*st.expr, ErrorCode::Cancelled, message);
+            return false;
+        }
+        cancel::Scope cancellation(&budget);
+
+        if (m_memLimit) m_memUsed = contextBytes();
+        par::OptionsScope parallel(m_parallel);
+        m_memo.assign(st.slots, nullptr);
+        auto v = eval(*st.expr);
+        m_memo.clear();
+        if (!v) return false;
+        if (!st.target.empty()) assign(st.target, std::move(v));
+        else out = std::move(v);
+        return true;
     }
 
-    // factor := '-' factor | primary
-    ValuePtr Interpreter::parseFactor(Tokenizer& tz) {
-        if (tz.match(TokType::Minus)) {
-            auto v = parseFactor(tz);
-            // 0 - v
-            auto zero = RationalValue::create(0);
-            return zero->sub(*v);
-        }
-        return parsePrimary(tz);
+    ValuePtr Interpreter::fail(const Node& at, ErrorCode code, std::string message) {
+        if (!m_error) m_error = Diagnostic{ code, at.line, at.col, std::move(message) };
+        return nullptr;
     }
 
-    ValuePtr Interpreter::parsePrimary(Tokenizer& tz) {
-        const auto& t = tz.peek();
+    LineResult Interpreter::tryExecuteLine(const std::string& line) {
+        LineResult res;
+        auto parsed = Parser::parseLine(line);
+        if (parsed.error) { res.error = std::move(parsed.error); return res; }
+        if (!parsed.stmt.expr) { run(parsed.stmt, res.value); return res; }
+
+        const auto isDefined = [this](const std::string& name) { return m_ctx.find(name) != nullptr; };
+        if (auto d = checkNames(*parsed.stmt.expr, isDefined)) { res.error = std::move(d); return res; }
+
+        optimize(parsed.stmt, m_mode);
+        const Node& root = *parsed.stmt.expr;
+        bool ok = false;
+        res.error = guarded(root.line, root.col, [&] { ok = run(parsed.stmt, res.value); });
+        if (!ok) {
+            m_memo.clear();
+            res.value.reset();
+            if (!res.error) res.error = std::move(m_error);
+        }
+        return res;
+    }
 
-        if (tz.match(TokType::Number)) {
-            return parseNumber(t);
+    // Строки сценария без '\n' и '\r' в конце; номер строки — индекс + 1.
+    static std::vector<std::string> scriptLines(const std::string& script) {
+        std::vector<std::string> lines;
+        size_t pos = 0;
+        while (pos <= script.size()) {
+            size_t end = script.find('\n', pos);
+            if (end == std::string::npos) end = script.size();
+            lines.push_back(script.substr(pos, end - pos));
+            pos = end + 1;
+            if (!lines.back().empty() && lines.back().back() == '\r') lines.back().pop_back();
         }
+        return lines;
+    }
 
-        if (tz.match(TokType::Ident)) {
-            // function call: IDENT '(' expr ')'
-            if (tz.peek().type == TokType::LParen) {
-                return parseFunctionCall(tz, t.text);
-            }
+    static void collectVariables(const Node& n, std::set<std::string>& out) {
+        if (n.kind == NodeKind::Variable) out.insert(n.name);
+        for (auto& a : n.args) collectVariables(*a, out);
+    }
 
-            // variable
-            auto it = m_ctx.vars.find(t.text);
-            if (it == m_ctx.vars.end()) throw EvalError("Неизвестная переменная: " + t.text);
-            return it->second;
+    std::vector<Diagnostic> Interpreter::validateScript(const std::string& script) const {
+        std::vector<Diagnostic> out;
+        std::set<std::string> assigned;
+        const auto isDefined = [&](const std::string& name) {
+            return assigned.count(name) != 0 || m_ctx.find(name) != nullptr;
+        };
+
+        int lineNo = 0;
+        for (auto& line : scriptLines(script)) {
+            ++lineNo;
+            auto parsed = Parser::parseLine(line);
+            std::optional<Diagnostic> d = std::move(parsed.error);
+            if (!d && parsed.stmt.expr) d = checkNames(*parsed.stmt.expr, isDefined);
+
+            if (d) {
+                d->line = lineNo;
+                out.push_back(std::move(*d));
+            }
+            else if (!parsed.stmt.target.empty()) {
+                assigned.insert(parsed.stmt.target);
+            }
         }
+        return out;
+    }
 
-        if (tz.match(TokType::LParen)) {
-            auto v = parseExpr(tz);
-            expect(tz, TokType::RParen, "Ожидалась ')'.");
-            return v;
+    std::vector<BatchResult> Interpreter::executeBatch(const std::string& script, const std::vector<Bindings>& runs) const {
+        // Строка сценария после разбора. Общая (shared) строка не читает привязанных
+        // переменных и присвоенных зависимыми строками выше — её результат одинаков во всех
+        // прогонах и считается один раз.
+        struct Line {
+            Statement stmt;
+            bool shared{ true };
+            std::optional<ValuePtr> value;    // результат общей строки
+            std::optional<Diagnostic> error;  // ошибка разбора или общей строки
+        };
+
+        std::set<std::string> dependent;
+        for (auto& b : runs)
+            for (auto& kv : b) dependent.insert(kv.first);
+
+        std::vector<Line> lines;
+        NumericMode mode = m_mode;
+        int lineNo = 0;
+        for (auto& text : scriptLines(script)) {
+            ++lineNo;
+            Line ln;
+            auto parsed = Parser::parseLine(text);
+            if (parsed.error) {
+                ln.error = std::move(parsed.error);
+                ln.error->line = lineNo;
+                lines.push_back(std::move(ln));
+                break; // дальше не выполняется ни один прогон
+            }
+            ln.stmt = std::move(parsed.stmt);
+            // Режим строки известен заранее: прогоны начинают с m_mode и меняют его по порядку
+            if (ln.stmt.mode) mode = *ln.stmt.mode;
+            optimize(ln.stmt, mode);
+            if (ln.stmt.expr) {
+                std::set<std::string> used;
+                collectVariables(*ln.stmt.expr, used);
+                for (auto& name : used)
+                    if (dependent.count(name)) { ln.shared = false; break; }
+            }
+            // Присваивание общей строкой снова делает переменную одинаковой во всех прогонах
+            if (!ln.stmt.target.empty()) {
+                if (ln.shared) dependent.erase(ln.stmt.target);
+                else dependent.insert(ln.stmt.target);
+            }
+            lines.push_back(std::move(ln));
         }
 
-        if (tz.match(TokType::LBracket)) {
-            return parseVectorOrMatrix(tz);
+        // Ошибка строки k сценария: статус вычислителя или исключение ядра.
+        const auto step = [](Interpreter& in, const Statement& st, size_t k, std::optional<ValuePtr>& v) {
+            bool ok = false;
+            auto d = guarded(static_cast<int>(k + 1), st.expr ? st.expr->col : 1, [&] { ok = in.run(st, v); });
+            if (!ok && !d) {
+                d = std::move(in.m_error);
+                d->line = static_cast<int>(k + 1);
+            }
+            if (!ok) in.m_memo.clear();
+            return d;
+        };
+
+        // Общие строки — по порядку в копии этого интерпретатора: они читают только
+        // переменные, которые последними присвоили общие строки (или контекст).
+        {
+            Interpreter common(*this);
+            common.m_publish = false;
+            for (size_t k = 0; k < lines.size(); ++k) {
+                auto& ln = lines[k];
+                if (ln.error) break;
+                if (!ln.shared) continue;
+                ln.error = step(common, ln.stmt, k, ln.value);
+                if (ln.error) break;
+                if (!ln.stmt.target.empty()) ln.value = common.m_ctx.vars[ln.stmt.target];
+            }
         }
 
-        throw ParseError(t.line, t.col, "Ожидалось выражение.");
+        // Прогоны: собственные переменные — привязки и присвоенное сценарием,
+        // остальное читается из снимка текущего контекста.
+        auto base = snapshot();
+        std::vector<BatchResult> out(runs.size());
+        par::OptionsScope parallel(m_parallel);
+        par::parallelFor(runs.size(), 1, [&](size_t rb, size_t re) {
+            for (size_t r = rb; r < re; ++r) {
+                Interpreter run(base, Unpublished{});
+                run.m_ctx.vars = runs[r];
+                run.m_memLimit = m_memLimit;
+                run.m_parallel = m_parallel;
+                run.m_mode = m_mode;
+                run.m_cancel = m_cancel;
+                run.m_time.line = m_time.line;
+                auto& res = out[r];
+                for (size_t k = 0; k < lines.size(); ++k) {
+                    auto& ln = lines[k];
+                    if (ln.error) { res.error = ln.error; break; }
+                    if (ln.stmt.mode) run.m_mode = *ln.stmt.mode;
+                    if (!ln.stmt.expr) continue;
+                    std::optional<ValuePtr> v;
+                    if (ln.shared) {
+                        v = ln.value;
+                        if (!ln.stmt.target.empty()) {
+                            run.m_ctx.vars[ln.stmt.target] = *v;
+                            v.reset();
+                        }
+                    }
+                    else {
+                        res.error = step(run, ln.stmt, k, v);
+                        if (res.error) break;
+                    }
+                    if (v) res.values.push_back(std::move(*v));
+                }
+                res.vars = std::move(run.m_ctx.vars);
+            }
+        });
+        return out;
     }
 
-    ValuePtr Interpreter::parseFunctionCall(Tokenizer& tz, const std::string& name) {
-        expect(tz, TokType::LParen, "Ожидалась '('.");
-        auto arg = parseExpr(tz);
-        expect(tz, TokType::RParen, "Ожидалась ')'.");
-        if (name == "T") return arg->transpose();
-        throw EvalError("Неизвестная функция: " + name);
+    ValuePtr Interpreter::eval(const Node& n) {
+        if (n.slot < 0) return evalNode(n);
+        auto& cached = m_memo[static_cast<size_t>(n.slot)];
+        if (!cached) cached = evalNode(n);
+        return cached;
     }
 
-    static bool hasDot(const std::string& s) {
-        for (char c : s) if (c == '.') return true;
-        return false;
-    }
+    ValuePtr Interpreter::evalNode(const Node& n) {
+        switch (n.kind) {
+        case NodeKind::Literal:
+            return m_mode == NumericMode::Fast ? toInexact(n.value) : n.value;
 
-    ValuePtr Interpreter::parseNumber(const Token& tok) {
-        // Поддержка десятичных как рациональных: 3.25 = 325/100 -> 13/4
-        const std::string& s = tok.text;
+        case NodeKind::Variable: {
+            auto v = m_ctx.find(n.name);
+            if (!v) return fail(n, ErrorCode::UnknownVariable, "Неизвестная переменная: " + n.name);
+            return m_mode == NumericMode::Fast ? toInexact(*v) : *v;
+        }
 
-        if (!hasDot(s)) {
-            // int64
-            int64_t n = 0;
-            bool neg = false;
-            size_t i = 0;
-            if (i < s.size() && s[i] == '+') ++i;
-            if (i < s.size() && s[i] == '-') { neg = true; ++i; }
-            for (; i < s.size(); ++i) {
-                if (!std::isdigit(static_cast<unsigned char>(s[i])))
-                    throw ParseError(tok.line, tok.col, "Некорректное число.");
-                n = n * 10 + (s[i] - '0');
-            }
-            if (neg) n = -n;
-            return RationalValue::create(n);
+        case NodeKind::Negate: {
+            auto v = eval(*n.args[0]);
+            if (!v) return nullptr;
+            if (const char* message = cancel::expired()) return fail(n, ErrorCode::Cancelled, message);
+            if (m_memLimit && !reserveBytes(estimateNegateBytes(*v), n)) return nullptr;
+            return negate(*v);
         }
 
-        // decimal -> rational
-        // form: [digits]? '.' digits
-        std::string a, b;
-        size_t p = s.find('.');
-        a = (p == 0) ? "0" : s.substr(0, p);
-        b = s.substr(p + 1);
-        if (b.empty()) b = "0";
+        case NodeKind::Binary: {
+            if (n.op == TokType::Star) return evalProduct(n);
+            auto left = eval(*n.args[0]);
+            auto right = left ? eval(*n.args[1]) : nullptr;
+            if (!right) return nullptr;
+            if (const char* message = cancel::expired()) return fail(n, ErrorCode::Cancelled, message);
+            if (const char* message = checkBinaryOp(n.op, *left, *right)) return fail(n, ErrorCode::Evaluation, message);
+            if (m_memLimit && !reserveBytes(estimateBinaryBytes(n.op, *left, *right), n)) return nullptr;
+            return binaryOp(n.op, *left, *right);
+        }
 
-        bool neg = false;
-        if (!a.empty() && a[0] == '-') { neg = true; a = a.substr(1); }
-        if (a.empty()) a = "0";
+        case NodeKind::Call: {
+            std::vector<ValuePtr> args;
+            args.reserve(n.args.size());
+            if (isFileFunction(n.name)) {
+                // Результат в файле: лимит памяти не проверяется
+                std::vector<std::string> paths;
+                for (auto& a : n.args) {
+                    if (a->kind == NodeKind::Text) paths.push_back(a->name);
+                    else if (auto v = eval(*a)) args.push_back(std::move(v));
+                    else return nullptr;
+                }
+                if (const char* message = cancel::expired()) return fail(n, ErrorCode::Cancelled, message);
+                return callFileFunction(n.name, args, paths);
+            }
+            if (auto message = checkBuiltinCall(n.name, n.args.size()))
+                return fail(n, isBuiltinFunction(n.name) ? ErrorCode::Evaluation : ErrorCode::UnknownFunction, std::move(*message));
+            for (auto& a : n.args) {
+                if (auto v = eval(*a)) args.push_back(std::move(v));
+                else return nullptr;
+            }
+            if (const char* message = cancel::expired()) return fail(n, ErrorCode::Cancelled, message);
+            if (m_memLimit && !reserveBytes(estimateCallBytes(n.name, args), n)) return nullptr;
+            return callBuiltin(n.name, args);
+        }
 
-        int64_t intPart = 0;
-        for (char c : a) {
-            if (!std::isdigit(static_cast<unsigned char>(c))) throw ParseError(tok.line, tok.col, "Некорректное число.");
-            intPart = intPart * 10 + (c - '0');
+        case NodeKind::MatrixLit: {
+            auto v = evalMatrixLiteral(n);
+            if (!v) return nullptr;
+            return m_mode == NumericMode::Fast ? toInexact(v) : v;
         }
 
-        int64_t fracPart = 0;
-        int64_t den = 1;
-        for (char c : b) {
-            if (!std::isdigit(static_cast<unsigned char>(c))) throw ParseError(tok.line, tok.col, "Некорректное число.");
-            fracPart = fracPart * 10 + (c - '0');
-            den *= 10;
+        case NodeKind::Text:
+            return fail(n, ErrorCode::Evaluation, "Строка в кавычках допустима только как путь к файлу в open и save.");
         }
+        return fail(n, ErrorCode::Evaluation, "Неизвестный узел выражения.");
+    }
 
-        int64_t num = intPart * den + fracPart;
-        if (neg) num = -num;
-        return RationalValue::create(num, den);
+    // Сомножители цепочки '*' по порядку. Узлы с ячейкой кэша общих подвыражений —
+    // листья: их значение вычисляется (и кэшируется) целиком.
+    static void collectFactors(const Node& n, std::vector<const Node*>& out) {
+        if (n.kind == NodeKind::Binary && n.op == TokType::Star && n.slot < 0) {
+            collectFactors(*n.args[0], out);
+            collectFactors(*n.args[1], out);
+        }
+        else {
+            out.push_back(&n);
+        }
     }
 
-    ValuePtr Interpreter::parseVectorOrMatrix(Tokenizer& tz) {
-        // Внутри: элементы разделяются пробелами, строки матрицы отделяются ';'
-        // Пример: [ 1 0; 0 1 ]
-        // Закрывающая ']' уже НЕ съедена (мы съели '[' до вызова)
-        std::vector<std::vector<ValuePtr>> rows;
-        rows.push_back({});
+    // Размеры сомножителей цепочки для порядка умножения: dims[k] x dims[k + 1] — размер
+    // k-го; вектор допустим только последним (столбец). false — цепочку нельзя
+    // переставлять (несогласованные размеры или другие виды значений): тогда она
+    // вычисляется слева направо и ошибку сообщает сама операция.
+    static bool chainDims(const std::vector<ValuePtr>& mats, std::vector<size_t>& dims) {
+        for (size_t k = 0; k < mats.size(); ++k) {
+            size_t rows, cols;
+            if (mats[k]->kind() == ValueKind::Matrix) {
+                auto& m = static_cast<const MatrixValue&>(*mats[k]);
+                rows = m.rows();
+                cols = m.cols();
+            }
+            else if (mats[k]->kind() == ValueKind::Vector && k + 1 == mats.size() && k > 0) {
+                rows = static_cast<const VectorValue&>(*mats[k]).size();
+                cols = 1;
+            }
+            else {
+                return false;
+            }
+            if (k == 0) dims.push_back(rows);
+            else if (dims.back() != rows) return false;
+            dims.push_back(cols);
+        }
+        return true;
+    }
 
-        while (true) {
-            if (tz.peek().type == TokType::RBracket) {
-                tz.next(); // ]
-                break;
+    // Классическое ДП для цепочки матриц: split[i][j] — где разделить произведение
+    // сомножителей i..j, чтобы число умножений элементов было минимальным.
+    static std::vector<std::vector<size_t>> chainOrder(const std::vector<size_t>& dims) {
+        const size_t n = dims.size() - 1;
+        std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0.0));
+        std::vector<std::vector<size_t>> split(n, std::vector<size_t>(n, 0));
+        for (size_t len = 2; len <= n; ++len) {
+            for (size_t i = 0; i + len <= n; ++i) {
+                const size_t j = i + len - 1;
+                cost[i][j] = -1.0;
+                for (size_t k = i; k < j; ++k) {
+                    const double c = cost[i][k] + cost[k + 1][j] +
+                        static_cast<double>(dims[i]) * static_cast<double>(dims[k + 1]) * static_cast<double>(dims[j + 1]);
+                    if (cost[i][j] < 0 || c < cost[i][j]) { cost[i][j] = c; split[i][j] = k; }
+                }
             }
+        }
+        return split;
+    }
+
+    ValuePtr Interpreter::multiply(const ValuePtr& a, const ValuePtr& b, const Node& at) {
+        if (!a || !b) return nullptr;
+        if (const char* message = cancel::expired()) return fail(at, ErrorCode::Cancelled, message);
+        if (const char* message = checkBinaryOp(TokType::Star, *a, *b)) return fail(at, ErrorCode::Evaluation, message);
+        if (m_memLimit && !reserveBytes(estimateBinaryBytes(TokType::Star, *a, *b), at)) return nullptr;
+        return binaryOp(TokType::Star, *a, *b);
+    }
+
+    ValuePtr Interpreter::evalProduct(const Node& n) {
+        // Цепочка A * B * v вычисляется не слева направо, а в порядке с наименьшей
+        // стоимостью по размерам операндов (два произведения матрицы на вектор вместо
+        // произведения матриц); скалярные множители применяются к наименьшему операнду.
+        std::vector<const Node*> nodes;
+        collectFactors(*n.args[0], nodes);
+        collectFactors(*n.args[1], nodes);
+        std::vector<ValuePtr> values;
+        values.reserve(nodes.size());
+        for (auto* f : nodes) {
+            if (auto v = eval(*f)) values.push_back(std::move(v));
+            else return nullptr;
+        }
+
+        std::vector<ValuePtr> mats;
+        ValuePtr scalar;
+        size_t scalars = 0;
+        for (auto& v : values) {
+            if (!isScalar(v->kind())) { mats.push_back(v); continue; }
+            scalar = scalar ? multiply(scalar, v, n) : v;
+            if (!scalar) return nullptr;
+            ++scalars;
+        }
+
+        std::vector<size_t> dims;
+        if (mats.empty() || (mats.size() < 3 && scalars == 0) || !chainDims(mats, dims)) {
+            ValuePtr acc = values[0];
+            for (size_t k = 1; k < values.size() && acc; ++k) acc = multiply(acc, values[k], n);
+            return acc;
+        }
 
-            if (tz.match(TokType::Semicolon)) {
-                rows.push_back({});
-                continue;
+        // Скаляр — на операнд с наименьшим числом элементов (или на результат, если он меньше)
+        if (scalar) {
+            size_t best = mats.size(), bestSize = dims.front() * dims.back();
+            for (size_t k = 0; k < mats.size(); ++k) {
+                if (dims[k] * dims[k + 1] < bestSize) { best = k; bestSize = dims[k] * dims[k + 1]; }
             }
+            if (best < mats.size()) {
+                mats[best] = multiply(mats[best], scalar, n);
+                if (!mats[best]) return nullptr;
+                scalar = nullptr;
+            }
+        }
+
+        const auto split = chainOrder(dims);
+        std::function<ValuePtr(size_t, size_t)> product = [&](size_t i, size_t j) -> ValuePtr {
+            if (i == j) return mats[i];
+            const size_t k = split[i][j];
+            auto left = product(i, k);
+            return left ? multiply(left, product(k + 1, j), n) : nullptr;
+        };
+        auto res = product(0, mats.size() - 1);
+        return scalar ? multiply(res, scalar, n) : res;
+    }
 
-            auto v = parseExpr(tz);
-            if (!isScalar(v->kind())) throw EvalError("Элемент вектора/матрицы должен быть скаляром.");
-            rows.back().push_back(v);
+    bool Interpreter::reserveBytes(size_t bytes, const Node& at) {
+        // Результаты строки не вычитаются при освобождении: оценка сверху.
+        if (m_memUsed + bytes > m_memLimit) {
+            const size_t freeBytes = m_memUsed < m_memLimit ? m_memLimit - m_memUsed : 0;
+            fail(at, ErrorCode::Evaluation, "Превышен лимит памяти: операции нужно ~" + std::to_string(bytes) +
+                " байт, свободно " + std::to_string(freeBytes) + " из " + std::to_string(m_memLimit) + ".");
+            return false;
         }
+        m_memUsed += bytes;
+        return true;
+    }
 
-        // Удалим возможную пустую последнюю строку
-        if (!rows.empty() && rows.back().empty()) rows.pop_back();
-        if (rows.empty()) throw EvalError("Пустой литерал матрицы/вектора.");
+    size_t Interpreter::contextBytes() const {
+        std::unordered_set<const Value*> seen;
+        size_t total = 0;
+        for (auto& kv : m_ctx.vars)
+            if (seen.insert(kv.second.get()).second) total += kv.second->footprint();
+        return total;
+    }
 
-        // Если одна строка — это вектор
-        if (rows.size() == 1) {
-            return std::make_shared<VectorValue>(rows[0]);
+    std::vector<std::pair<std::string, size_t>> Interpreter::memoryUsage() const {
+        std::vector<std::pair<std::string, size_t>> out;
+        out.reserve(m_ctx.vars.size());
+        for (auto& kv : m_ctx.vars) out.emplace_back(kv.first, kv.second->footprint());
+        std::stable_sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        return out;
+    }
+
+    ValuePtr Interpreter::evalMatrixLiteral(const Node& n) {
+        std::vector<std::vector<ValuePtr>> rows;
+        size_t k = 0;
+        for (size_t len : n.rowSizes) {
+            rows.emplace_back();
+            rows.back().reserve(len);
+            for (size_t j = 0; j < len; ++j) {
+                auto v = eval(*n.args[k++]);
+                if (!v) return nullptr;
+                if (!isScalar(v->kind())) return fail(*n.args[k - 1], ErrorCode::Evaluation, "Элемент вектора/матрицы должен быть скаляром.");
+                rows.back().push_back(std::move(v));
+            }
         }
-        return std::make_shared<MatrixValue>(rows);
+
+        return makeMatrixLiteral(std::move(rows));
     }
 
 } // namespace mathcore
@@ -0,0 +1,103 @@
+﻿#include "pch.h"
+#include "MathCore/LinearAlgebra.h"
+#include "MathCore/VectorMatrix.h"
+#include "SmallKernels.h"
+
+namespace mathcore {
+
+    namespace {
+
+        const MatrixValue& squareMatrix(const Value& v, const char* fn) {
+            if (v.kind() != ValueKind::Matrix) throw EvalError(std::string("Функция ") + fn + " ожидает матрицу.");
+            auto& m = static_cast<const MatrixValue&>(v);
+            if (m.rows() != m.cols()) throw EvalError(std::string("Функция ") + fn + " ожидает квадратную матрицу.");
+            return m;
+        }
+
+        // Ранг берётся из кэшированного разложения, поэтому проверка бесплатна при повторных вызовах.
+        void requireNonsingular(const MatrixValue& m) {
+            if (m.rank() < m.rows()) throw EvalError("Матрица вырождена.");
+        }
+
+        // x = A^-1 b для одной правой части невырожденной A: диагональная матрица —
+        // деление, иначе прямой и обратный ход по кэшированному разложению.
+        std::vector<ValuePtr> solveOne(const MatrixValue& m, const std::vector<ValuePtr>& b) {
+            const size_t n = m.rows();
+            std::vector<ValuePtr> x(n);
+            if (m.isDiagonal()) {
+                auto& a = m.data();
+                for (size_t i = 0; i < n; ++i) x[i] = scalarDiv(*b[i], *a[i][i]);
+                return x;
+            }
+
+            auto& f = m.lu();
+            auto& lu = f.lu;
+            for (size_t i = 0; i < n; ++i) {
+                ValuePtr acc = b[f.perm[i]];
+                for (size_t j = 0; j < i; ++j) acc = scalarSub(*acc, *scalarMul(*lu[i][j], *x[j]));
+                x[i] = acc;
+            }
+            for (size_t i = n; i-- > 0;) {
+                ValuePtr acc = x[i];
+                for (size_t j = i + 1; j < n; ++j) acc = scalarSub(*acc, *scalarMul(*lu[i][j], *x[j]));
+                x[i] = scalarDiv(*acc, *lu[i][i]);
+            }
+            return x;
+        }
+
+    } // namespace
+
+    ValuePtr matrixDet(const Value& v) {
+        return squareMatrix(v, "det").det();
+    }
+
+    ValuePtr matrixInverse(const Value& v) {
+        auto& m = squareMatrix(v, "inv");
+        if (auto r = small::inverse(m)) return r;
+        requireNonsingular(m);
+
+        const size_t n = m.rows();
+        std::vector<std::vector<ValuePtr>> out(n, std::vector<ValuePtr>(n));
+        const ValuePtr zero = RationalValue::create(0), one = RationalValue::create(1);
+        std::vector<ValuePtr> e(n, zero);
+        for (size_t k = 0; k < n; ++k) {
+            e[k] = one;
+            auto col = solveOne(m, e);
+            for (size_t i = 0; i < n; ++i) out[i][k] = std::move(col[i]);
+            e[k] = zero;
+        }
+        return std::make_shared<MatrixValue>(std::move(out));
+    }
+
+    ValuePtr matrixSolve(const Value& a, const Value& b) {
+        auto& m = squareMatrix(a, "solve");
+        requireNonsingular(m);
+        const size_t n = m.rows();
+
+        if (b.kind() == ValueKind::Vector) {
+            auto& v = static_cast<const VectorValue&>(b);
+            if (v.size() != n) throw EvalError("Размер правой части не совпадает с числом строк матрицы.");
+            return std::make_shared<VectorValue>(solveOne(m, v.items()));
+        }
+        if (b.kind() == ValueKind::Matrix) {
+            auto& rhs = static_cast<const MatrixValue&>(b);
+            if (rhs.rows() != n) throw EvalError("Размер правой части не совпадает с числом строк матрицы.");
+            auto& bd = rhs.data();
+            std::vector<std::vector<ValuePtr>> out(n, std::vector<ValuePtr>(rhs.cols()));
+            std::vector<ValuePtr> col(n);
+            for (size_t k = 0; k < rhs.cols(); ++k) {
+                for (size_t i = 0; i < n; ++i) col[i] = bd[i][k];
+                auto x = solveOne(m, col);
+                for (size_t i = 0; i < n; ++i) out[i][k] = std::move(x[i]);
+            }
+            return std::make_shared<MatrixValue>(std::move(out));
+        }
+        throw EvalError("Функция solve ожидает вектор или матрицу правых частей.");
+    }
+
+    ValuePtr matrixRank(const Value& v) {
+        if (v.kind() != ValueKind::Matrix) throw EvalError("Функция rank ожидает матрицу.");
+        return RationalValue::create(static_cast<int64_t>(static_cast<const MatrixValue&>(v).rank()));
+    }
+
+} // namespace mathcore
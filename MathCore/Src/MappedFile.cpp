@@ -0,0 +1,141 @@
+﻿#include "pch.h"
+#include "MappedFile.h"
+#include "MathCore/Errors.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mathcore {
+
+    namespace {
+
+        [[noreturn]] void fail(const std::string& what, const std::string& path) {
+            throw EvalError(what + ": " + path);
+        }
+
+#ifndef _WIN32
+        // Диапазон, выровненный по страницам (требование madvise).
+        void alignToPages(uint64_t& offset, uint64_t& len) {
+            static const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+            const uint64_t begin = offset / page * page;
+            len += offset - begin;
+            offset = begin;
+        }
+#endif
+
+    } // namespace
+
+    std::shared_ptr<MappedFile> MappedFile::openReadOnly(const std::string& path) {
+        std::shared_ptr<MappedFile> f(new MappedFile());
+        f->m_path = path;
+#ifdef _WIN32
+        const std::wstring wpath = std::filesystem::u8path(path).wstring();
+        f->m_file = ::CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f->m_file == INVALID_HANDLE_VALUE) { f->m_file = nullptr; fail("Не удалось открыть файл", path); }
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(f->m_file, &size)) fail("Не удалось открыть файл", path);
+        f->m_size = static_cast<uint64_t>(size.QuadPart);
+#else
+        f->m_fd = ::open(path.c_str(), O_RDONLY);
+        if (f->m_fd < 0) fail("Не удалось открыть файл", path);
+        struct stat st {};
+        if (::fstat(f->m_fd, &st) != 0) fail("Не удалось открыть файл", path);
+        f->m_size = static_cast<uint64_t>(st.st_size);
+#endif
+        f->map(false);
+        return f;
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::create(const std::string& path, uint64_t size, bool temporary) {
+        std::shared_ptr<MappedFile> f(new MappedFile());
+        f->m_path = path;
+        f->m_size = size;
+        f->m_temporary = temporary;
+#ifdef _WIN32
+        const std::wstring wpath = std::filesystem::u8path(path).wstring();
+        f->m_file = ::CreateFileW(wpath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f->m_file == INVALID_HANDLE_VALUE) { f->m_file = nullptr; fail("Не удалось создать файл", path); }
+#else
+        f->m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (f->m_fd < 0) fail("Не удалось создать файл", path);
+        // Разреженный файл: нулевые страницы не занимают места, пока в них не пишут
+        if (::ftruncate(f->m_fd, static_cast<off_t>(size)) != 0) fail("Не удалось создать файл", path);
+#endif
+        f->map(true);
+        return f;
+    }
+
+    void MappedFile::map(bool writable) {
+        if (m_size == 0) return;
+#ifdef _WIN32
+        const DWORD protect = writable ? PAGE_READWRITE : PAGE_READONLY;
+        m_mapping = ::CreateFileMappingW(m_file, nullptr, protect,
+            static_cast<DWORD>(m_size >> 32), static_cast<DWORD>(m_size & 0xFFFFFFFFu), nullptr);
+        if (!m_mapping) fail("Не удалось отобразить файл в память", m_path);
+        void* p = ::MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (!p) fail("Не удалось отобразить файл в память", m_path);
+        m_data = static_cast<uint8_t*>(p);
+#else
+        void* p = ::mmap(nullptr, m_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+        if (p == MAP_FAILED) fail("Не удалось отобразить файл в память", m_path);
+        m_data = static_cast<uint8_t*>(p);
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef _WIN32
+        if (m_data) ::UnmapViewOfFile(m_data);
+        if (m_mapping) ::CloseHandle(m_mapping);
+        if (m_file) ::CloseHandle(m_file);
+#else
+        if (m_data) ::munmap(m_data, m_size);
+        if (m_fd >= 0) ::close(m_fd);
+#endif
+        if (m_temporary) {
+            std::error_code ec;
+            std::filesystem::remove(std::filesystem::u8path(m_path), ec);
+        }
+    }
+
+    void MappedFile::willNeed(uint64_t offset, uint64_t len) const {
+        if (!m_data || offset >= m_size) return;
+        len = std::min(len, m_size - offset);
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range{ m_data + offset, static_cast<SIZE_T>(len) };
+        ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+        alignToPages(offset, len);
+        ::madvise(m_data + offset, len, MADV_WILLNEED);
+#endif
+    }
+
+    void MappedFile::dontNeed(uint64_t offset, uint64_t len) const {
+        if (!m_data || offset >= m_size) return;
+        len = std::min(len, m_size - offset);
+#ifdef _WIN32
+        // Страницы отображения Windows вытесняет сама по мере нехватки памяти
+        (void)offset;
+        (void)len;
+#else
+        alignToPages(offset, len);
+        ::madvise(m_data + offset, len, MADV_DONTNEED);
+#endif
+    }
+
+} // namespace mathcore
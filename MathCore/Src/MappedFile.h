@@ -0,0 +1,50 @@
+﻿#pragma once
+// Файл, целиком отображённый в память (mmap / MapViewOfFile).
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace mathcore {
+
+    class MappedFile {
+    public:
+        // Существующий файл только для чтения. Ошибки — EvalError.
+        static std::shared_ptr<MappedFile> openReadOnly(const std::string& path);
+        // Новый файл размера size (существующий перезаписывается) для чтения и записи.
+        // temporary — удалить файл при закрытии отображения.
+        static std::shared_ptr<MappedFile> create(const std::string& path, uint64_t size, bool temporary);
+
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        uint8_t* data() const { return m_data; }
+        uint64_t size() const { return m_size; }
+        const std::string& path() const { return m_path; }
+        bool temporary() const { return m_temporary; }
+
+        // Подсказки ОС для потоковой обработки: диапазон скоро понадобится (начать
+        // чтение с диска заранее) / больше не нужен процессу (страницы можно вытеснить;
+        // записанные данные остаются в файле).
+        void willNeed(uint64_t offset, uint64_t len) const;
+        void dontNeed(uint64_t offset, uint64_t len) const;
+
+    private:
+        MappedFile() = default;
+        void map(bool writable);
+
+        std::string m_path;
+        uint8_t* m_data{ nullptr };
+        uint64_t m_size{ 0 };
+        bool m_temporary{ false };
+#ifdef _WIN32
+        void* m_file{ nullptr };
+        void* m_mapping{ nullptr };
+#else
+        int m_fd{ -1 };
+#endif
+    };
+
+} // namespace mathcore
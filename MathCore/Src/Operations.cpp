@@ -0,0 +1,512 @@
+﻿#include "pch.h"
+#include "MathCore/Operations.h"
+#include "MathCore/DiskMatrix.h"
+#include "MathCore/Errors.h"
+#include "MathCore/VectorMatrix.h"
+#include "MathCore/Reductions.h"
+#include "MathCore/LinearAlgebra.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <initializer_list>
+
+namespace mathcore {
+
+    // ---- Скалярные ядра ----
+    // Рациональное и комплексное число в любом сочетании считаются прямо по значениям
+    // операндов: рациональное не превращается во временный ComplexValue.
+
+    namespace {
+
+        using cplx = std::complex<double>;
+
+        const RationalValue& rat(const Value& v) { return static_cast<const RationalValue&>(v); }
+
+        cplx cplxOf(const Value& v) {
+            if (v.kind() == ValueKind::Complex) return static_cast<const ComplexValue&>(v).value();
+            return { static_cast<double>(rat(v).num()) / static_cast<double>(rat(v).den()), 0.0 };
+        }
+
+        ValuePtr makeComplex(cplx z) { return ComplexValue::create(z.real(), z.imag()); }
+
+        template <ElemOp op>
+        ValuePtr scalarKernel(const Value& a, const Value& b) {
+            if (!isScalar(a.kind()) || !isScalar(b.kind())) {
+                // Не скаляры: правило самого типа (расширение скаляра или ошибка)
+                switch (op) {
+                case ElemOp::Add: return a.add(b);
+                case ElemOp::Sub: return a.sub(b);
+                case ElemOp::Mul: return a.mul(b);
+                default:          return a.div(b);
+                }
+            }
+            if (a.kind() == ValueKind::Rational && b.kind() == ValueKind::Rational) {
+                auto& x = rat(a);
+                auto& y = rat(b);
+                switch (op) {
+                case ElemOp::Add: // a/b + c/d = (ad + cb)/bd
+                    return RationalValue::create(x.num() * y.den() + y.num() * x.den(), x.den() * y.den());
+                case ElemOp::Sub:
+                    return RationalValue::create(x.num() * y.den() - y.num() * x.den(), x.den() * y.den());
+                case ElemOp::Mul:
+                    return RationalValue::create(x.num() * y.num(), x.den() * y.den());
+                default:
+                    if (y.num() == 0) throw EvalError("Деление на ноль.");
+                    return RationalValue::create(x.num() * y.den(), x.den() * y.num());
+                }
+            }
+            const cplx x = cplxOf(a), y = cplxOf(b);
+            switch (op) {
+            case ElemOp::Add: return makeComplex(x + y);
+            case ElemOp::Sub: return makeComplex(x - y);
+            case ElemOp::Mul: return makeComplex(x * y);
+            default:
+                if (std::abs(y.real()) < 1e-18 && std::abs(y.imag()) < 1e-18) throw EvalError("Деление на ноль.");
+                return makeComplex(x / y);
+            }
+        }
+
+    } // namespace
+
+    ValuePtr scalarAdd(const Value& a, const Value& b) { return scalarKernel<ElemOp::Add>(a, b); }
+    ValuePtr scalarSub(const Value& a, const Value& b) { return scalarKernel<ElemOp::Sub>(a, b); }
+    ValuePtr scalarMul(const Value& a, const Value& b) { return scalarKernel<ElemOp::Mul>(a, b); }
+    ValuePtr scalarDiv(const Value& a, const Value& b) { return scalarKernel<ElemOp::Div>(a, b); }
+
+    // ---- Таблица бинарных операций ----
+    // Ядро выбирается одним обращением по (вид левого, вид правого, операция) без цепочек
+    // проверок kind() и виртуальных вызовов. Новый вид значения — новая строка и столбец.
+
+    namespace {
+
+        using Kernel = ValuePtr(*)(const Value&, const Value&);
+
+        constexpr size_t kKinds = static_cast<size_t>(ValueKind::DiskMatrix) + 1;
+        constexpr TokType kOps[] = { TokType::Plus, TokType::Minus, TokType::Star, TokType::Slash,
+            TokType::Caret, TokType::DotStar, TokType::DotSlash };
+        constexpr size_t kOpCount = sizeof(kOps) / sizeof(kOps[0]);
+
+        size_t opIndex(TokType op) {
+            for (size_t i = 0; i < kOpCount; ++i)
+                if (kOps[i] == op) return i;
+            throw EvalError("Неизвестная операция.");
+        }
+
+        // Скаляр с вектором или матрицей (с любой стороны), поэлементные операции:
+        // расширение скаляра, без перестановки операндов и промежуточных значений.
+        template <ElemOp op>
+        ValuePtr broadcast(const Value& a, const Value& b) { return elementwise(op, a, b, ""); }
+
+        ValuePtr emulKernel(const Value& a, const Value& b) {
+            return elementwise(ElemOp::Mul, a, b, "Нельзя умножить поэлементно: несовместимые размеры.");
+        }
+        ValuePtr edivKernel(const Value& a, const Value& b) {
+            return elementwise(ElemOp::Div, a, b, "Нельзя разделить поэлементно: несовместимые размеры.");
+        }
+
+        // Вектор и матрица друг с другом: правила конкретного типа (размеры, произведение
+        // матриц); классы final, поэтому вызов прямой.
+        template <class T>
+        struct Own {
+            static ValuePtr add(const Value& a, const Value& b) { return static_cast<const T&>(a).add(b); }
+            static ValuePtr sub(const Value& a, const Value& b) { return static_cast<const T&>(a).sub(b); }
+            static ValuePtr mul(const Value& a, const Value& b) { return static_cast<const T&>(a).mul(b); }
+            static ValuePtr div(const Value& a, const Value& b) { return static_cast<const T&>(a).div(b); }
+            static ValuePtr pow(const Value& a, const Value& b) { return static_cast<const T&>(a).pow(b); }
+        };
+
+        template <TokType op>
+        ValuePtr diskKernel(const Value& a, const Value& b) { return diskBinaryOp(op, a, b); }
+
+        ValuePtr noDiv(const Value&, const Value&) { throw EvalError("Операция '/' не поддерживается для данных типов."); }
+        ValuePtr noPow(const Value&, const Value&) { throw EvalError("Операция '^' не поддерживается для данных типов."); }
+
+        struct DispatchTable {
+            Kernel k[kKinds][kKinds][kOpCount]{};
+
+            void set(ValueKind l, ValueKind r, std::initializer_list<Kernel> ops) {
+                size_t i = 0;
+                for (Kernel f : ops) k[static_cast<size_t>(l)][static_cast<size_t>(r)][i++] = f;
+            }
+        };
+
+        DispatchTable buildDispatch() {
+            const ValueKind scalars[] = { ValueKind::Rational, ValueKind::Complex };
+            const ValueKind containers[] = { ValueKind::Vector, ValueKind::Matrix };
+            DispatchTable t;
+            // Порядок ядер — как в kOps: + - * / ^ .* ./
+            for (ValueKind l : scalars) {
+                for (ValueKind r : scalars)
+                    t.set(l, r, { scalarAdd, scalarSub, scalarMul, scalarDiv,
+                        l == ValueKind::Rational ? Own<RationalValue>::pow : Own<ComplexValue>::pow,
+                        scalarMul, scalarDiv });
+                for (ValueKind r : containers)
+                    t.set(l, r, { broadcast<ElemOp::Add>, broadcast<ElemOp::Sub>, broadcast<ElemOp::Mul>, noDiv,
+                        noPow, emulKernel, edivKernel });
+            }
+            for (ValueKind r : scalars) {
+                t.set(ValueKind::Vector, r, { broadcast<ElemOp::Add>, broadcast<ElemOp::Sub>, broadcast<ElemOp::Mul>,
+                    broadcast<ElemOp::Div>, Own<VectorValue>::pow, emulKernel, edivKernel });
+                t.set(ValueKind::Matrix, r, { broadcast<ElemOp::Add>, broadcast<ElemOp::Sub>, broadcast<ElemOp::Mul>,
+                    broadcast<ElemOp::Div>, Own<MatrixValue>::pow, emulKernel, edivKernel });
+            }
+            for (ValueKind r : containers) {
+                t.set(ValueKind::Vector, r, { Own<VectorValue>::add, Own<VectorValue>::sub, Own<VectorValue>::mul,
+                    Own<VectorValue>::div, Own<VectorValue>::pow, emulKernel, edivKernel });
+                t.set(ValueKind::Matrix, r, { Own<MatrixValue>::add, Own<MatrixValue>::sub, Own<MatrixValue>::mul,
+                    Own<MatrixValue>::div, Own<MatrixValue>::pow, emulKernel, edivKernel });
+            }
+            // Матрица на диске с любой стороны: потоковые ядра по тайлам
+            const std::initializer_list<Kernel> disk = { diskKernel<TokType::Plus>, diskKernel<TokType::Minus>,
+                diskKernel<TokType::Star>, diskKernel<TokType::Slash>, diskKernel<TokType::Caret>,
+                diskKernel<TokType::DotStar>, diskKernel<TokType::DotSlash> };
+            for (size_t i = 0; i < kKinds; ++i) {
+                t.set(ValueKind::DiskMatrix, static_cast<ValueKind>(i), disk);
+                t.set(static_cast<ValueKind>(i), ValueKind::DiskMatrix, disk);
+            }
+            return t;
+        }
+
+        const DispatchTable& dispatchTable() {
+            static const DispatchTable table = buildDispatch();
+            return table;
+        }
+
+    } // namespace
+
+    ValuePtr binaryOp(TokType op, const Value& left, const Value& right) {
+        const size_t i = opIndex(op);
+        return dispatchTable().k[static_cast<size_t>(left.kind())][static_cast<size_t>(right.kind())][i](left, right);
+    }
+
+    namespace {
+
+        bool isZeroScalar(const Value& v) {
+            if (v.kind() == ValueKind::Rational) return rat(v).num() == 0;
+            const cplx z = cplxOf(v);
+            return std::abs(z.real()) < 1e-18 && std::abs(z.imag()) < 1e-18;
+        }
+
+        bool hasBoxedZero(const VectorValue& v) {
+            for (auto& x : v.items())
+                if (isZeroScalar(*x)) return true;
+            return false;
+        }
+
+        bool hasBoxedZero(const MatrixValue& m) {
+            for (auto& row : m.data())
+                for (auto& x : row)
+                    if (isZeroScalar(*x)) return true;
+            return false;
+        }
+
+        // Есть ли нулевой элемент (делитель в './'). Целые и упакованные элементы читаются
+        // из своего хранения: items()/data() упаковали бы каждый в отдельный Value.
+        template <class T>
+        bool hasZeroElement(const T& v) {
+            if (v.isInteger()) return std::find(v.ints().begin(), v.ints().end(), 0) != v.ints().end();
+            if (v.isPacked()) {
+                for (const cplx& z : v.packed())
+                    if (std::abs(z.real()) < 1e-18 && std::abs(z.imag()) < 1e-18) return true;
+                return false;
+            }
+            return hasBoxedZero(v);
+        }
+
+        bool hasZeroElement(const Value& v) {
+            if (v.kind() == ValueKind::Vector) return hasZeroElement(static_cast<const VectorValue&>(v));
+            return hasZeroElement(static_cast<const MatrixValue&>(v));
+        }
+
+        // Строки и столбцы вектора (строка 1xN) или матрицы.
+        void dimsOf(const Value& v, size_t& rows, size_t& cols) {
+            if (v.kind() == ValueKind::Vector) {
+                rows = 1;
+                cols = static_cast<const VectorValue&>(v).size();
+            }
+            else {
+                rows = static_cast<const MatrixValue&>(v).rows();
+                cols = static_cast<const MatrixValue&>(v).cols();
+            }
+        }
+
+        // Правило расширения elementwise: размеры равны или один из них равен 1.
+        bool broadcastable(const Value& a, const Value& b) {
+            size_t ar, ac, br, bc;
+            dimsOf(a, ar, ac);
+            dimsOf(b, br, bc);
+            return (ar == br || ar == 1 || br == 1) && (ac == bc || ac == 1 || bc == 1);
+        }
+
+        const char* checkContainers(TokType op, const Value& l, const Value& r) {
+            const bool lVec = l.kind() == ValueKind::Vector, rVec = r.kind() == ValueKind::Vector;
+            switch (op) {
+            case TokType::Plus:
+            case TokType::Minus: {
+                const bool plus = op == TokType::Plus;
+                if (lVec && rVec) {
+                    if (static_cast<const VectorValue&>(l).size() == static_cast<const VectorValue&>(r).size()) return nullptr;
+                    return plus ? "Нельзя сложить векторы разных размеров." : "Нельзя вычесть векторы разных размеров.";
+                }
+                if (broadcastable(l, r)) return nullptr;
+                if (lVec) return plus ? "Нельзя сложить: несовместимые размеры." : "Нельзя вычесть: несовместимые размеры.";
+                return plus ? "Нельзя сложить матрицы разных размеров." : "Нельзя вычесть матрицы разных размеров.";
+            }
+            case TokType::Star: {
+                if (lVec) return "Операция '*' не поддерживается для данных типов.";
+                auto& m = static_cast<const MatrixValue&>(l);
+                if (rVec) {
+                    if (m.cols() == static_cast<const VectorValue&>(r).size()) return nullptr;
+                    return "Нельзя умножить: число столбцов матрицы не равно размеру вектора.";
+                }
+                if (m.cols() == static_cast<const MatrixValue&>(r).rows()) return nullptr;
+                return "Нельзя умножить матрицы: A.cols != B.rows.";
+            }
+            case TokType::Slash: return "Операция '/' не поддерживается для данных типов.";
+            case TokType::Caret: return "Операция '^' не поддерживается для данных типов.";
+            case TokType::DotStar:
+                return broadcastable(l, r) ? nullptr : "Нельзя умножить поэлементно: несовместимые размеры.";
+            case TokType::DotSlash:
+                if (!broadcastable(l, r)) return "Нельзя разделить поэлементно: несовместимые размеры.";
+                return hasZeroElement(r) ? "Деление на ноль." : nullptr;
+            default: return nullptr;
+            }
+        }
+
+        const char* checkMatrixPower(const MatrixValue& m, const Value& e) {
+            bool ok = false;
+            if (e.kind() == ValueKind::Rational) ok = rat(e).den() == 1 && rat(e).num() >= 0;
+            else {
+                const cplx z = cplxOf(e);
+                ok = z.imag() == 0.0 && z.real() >= 0.0 && z.real() < 9.2e18 && std::floor(z.real()) == z.real();
+            }
+            if (!ok) return "Матрицу можно возводить только в целую неотрицательную степень.";
+            if (m.rows() != m.cols()) return "Возводить в степень можно только квадратную матрицу.";
+            return nullptr;
+        }
+
+    } // namespace
+
+    const char* checkBinaryOp(TokType op, const Value& left, const Value& right) {
+        const ValueKind a = left.kind(), b = right.kind();
+        // Матрицы на диске проверяют сами ядра по тайлам
+        if (a == ValueKind::DiskMatrix || b == ValueKind::DiskMatrix) return nullptr;
+        const bool ls = isScalar(a), rs = isScalar(b);
+        if (ls && rs) {
+            if ((op == TokType::Slash || op == TokType::DotSlash) && isZeroScalar(right)) return "Деление на ноль.";
+            // Ноль в отрицательной целой степени
+            if (op == TokType::Caret && b == ValueKind::Rational && rat(right).den() == 1 && rat(right).num() < 0 &&
+                isZeroScalar(left))
+                return "Деление на ноль.";
+            return nullptr;
+        }
+        if (ls) {
+            if (op == TokType::Slash) return "Операция '/' не поддерживается для данных типов.";
+            if (op == TokType::Caret) return "Операция '^' не поддерживается для данных типов.";
+            if (op == TokType::DotSlash && hasZeroElement(right)) return "Деление на ноль.";
+            return nullptr;
+        }
+        if (rs) {
+            if ((op == TokType::Slash || op == TokType::DotSlash) && isZeroScalar(right)) return "Деление на ноль.";
+            if (op == TokType::Caret) {
+                if (a == ValueKind::Vector) return "Операция '^' не поддерживается для данных типов.";
+                return checkMatrixPower(static_cast<const MatrixValue&>(left), right);
+            }
+            return nullptr;
+        }
+        return checkContainers(op, left, right);
+    }
+
+    ValuePtr negate(const Value& v) {
+        return v.neg();
+    }
+
+    namespace {
+
+        using Args = std::vector<ValuePtr>;
+
+        // Размер результата встроенной функции (для оценки памяти).
+        enum class ResultSize {
+            Scalar,
+            LikeArg,       // как первый аргумент (та же форма и представление)
+            BoxedLikeArg,  // форма первого аргумента, рациональные элементы
+            BoxedLikeLast, // форма последнего аргумента, рациональные элементы
+        };
+
+        struct Builtin {
+            const char* name;
+            size_t arity;
+            ResultSize size;
+            ValuePtr(*fn)(const Args&);
+        };
+
+        const Builtin kBuiltins[] = {
+            { "T",     1, ResultSize::LikeArg,       [](const Args& a) { return a[0]->transpose(); } },
+            { "sum",   1, ResultSize::Scalar,        [](const Args& a) { return reduceSum(*a[0]); } },
+            { "mean",  1, ResultSize::Scalar,        [](const Args& a) { return reduceMean(*a[0]); } },
+            { "min",   1, ResultSize::Scalar,        [](const Args& a) { return reduceMin(*a[0]); } },
+            { "max",   1, ResultSize::Scalar,        [](const Args& a) { return reduceMax(*a[0]); } },
+            { "norm",  1, ResultSize::Scalar,        [](const Args& a) { return reduceNorm(*a[0]); } },
+            { "trace", 1, ResultSize::Scalar,        [](const Args& a) { return reduceTrace(*a[0]); } },
+            { "dot",   2, ResultSize::Scalar,        [](const Args& a) { return reduceDot(*a[0], *a[1]); } },
+            { "det",   1, ResultSize::Scalar,        [](const Args& a) { return matrixDet(*a[0]); } },
+            { "inv",   1, ResultSize::BoxedLikeArg,  [](const Args& a) { return matrixInverse(*a[0]); } },
+            { "rank",  1, ResultSize::Scalar,        [](const Args& a) { return matrixRank(*a[0]); } },
+            { "solve", 2, ResultSize::BoxedLikeLast, [](const Args& a) { return matrixSolve(*a[0], *a[1]); } },
+            { "load",  1, ResultSize::BoxedLikeArg,  [](const Args& a) { return loadDiskMatrix(*a[0]); } },
+        };
+
+        const Builtin* findBuiltin(const std::string& name) {
+            for (auto& b : kBuiltins)
+                if (name == b.name) return &b;
+            return nullptr;
+        }
+
+    } // namespace
+
+    bool isBuiltinFunction(const std::string& name) {
+        return findBuiltin(name) != nullptr;
+    }
+
+    std::optional<std::string> checkBuiltinCall(const std::string& name, size_t argCount) {
+        auto b = findBuiltin(name);
+        if (!b) return "Неизвестная функция: " + name;
+        if (argCount != b->arity) return "Функция " + name + " ожидает аргументов: " + std::to_string(b->arity) + ".";
+        return std::nullopt;
+    }
+
+    ValuePtr callBuiltin(const std::string& name, const std::vector<ValuePtr>& args) {
+        if (auto err = checkBuiltinCall(name, args.size())) throw EvalError(*err);
+        return findBuiltin(name)->fn(args);
+    }
+
+    bool isFileFunction(const std::string& name) {
+        return name == "open" || name == "save";
+    }
+
+    ValuePtr callFileFunction(const std::string& name, const std::vector<ValuePtr>& args,
+        const std::vector<std::string>& paths) {
+        const size_t arity = name == "save" ? 1 : 0;
+        if (paths.size() != 1 || args.size() != arity) {
+            throw EvalError(name == "save" ? "Функция save ожидает матрицу и путь в кавычках: save(M, \"файл\")."
+                : "Функция open ожидает путь в кавычках: open(\"файл\").");
+        }
+        if (name == "save") return saveDiskMatrix(*args[0], paths[0]);
+        return DiskMatrixValue::open(paths[0]);
+    }
+
+    namespace {
+
+        struct Shape {
+            size_t rows{ 1 }, cols{ 1 };
+            bool container{ false }, matrix{ false }, integer{ true };
+            bool packed{ false }; // элементы подряд как complex<double> (режим fast)
+            bool disk{ false };   // результат в файле: в памяти только сам объект
+        };
+
+        // Результат упакован, только если упакованы все векторы и матрицы среди
+        // операндов: иначе ядра считают точно и упаковывают элементы в Value.
+        bool packedResult(const Shape& a, const Shape& b) {
+            return (a.packed || b.packed) && (a.packed || !a.container) && (b.packed || !b.container);
+        }
+
+        Shape shapeOf(const Value& v) {
+            Shape s;
+            if (v.kind() == ValueKind::Vector) {
+                auto& x = static_cast<const VectorValue&>(v);
+                s.cols = x.size();
+                s.container = true;
+                s.integer = x.isInteger();
+                s.packed = x.isPacked();
+            }
+            else if (v.kind() == ValueKind::Matrix) {
+                auto& m = static_cast<const MatrixValue&>(v);
+                s.rows = m.rows();
+                s.cols = m.cols();
+                s.container = s.matrix = true;
+                s.integer = m.isInteger();
+                s.packed = m.isPacked();
+            }
+            else if (v.kind() == ValueKind::DiskMatrix) {
+                auto& m = static_cast<const DiskMatrixValue&>(v);
+                s.rows = static_cast<size_t>(m.rows());
+                s.cols = static_cast<size_t>(m.cols());
+                s.container = s.matrix = s.disk = true;
+                s.integer = false;
+            }
+            else {
+                // Скаляр сохраняет целое хранение результата, только если он сам целый
+                s.integer = v.kind() == ValueKind::Rational && rat(v).den() == 1;
+            }
+            return s;
+        }
+
+        size_t bytesFor(const Shape& s) {
+            if (s.disk) return sizeof(DiskMatrixValue) + Value::kSharedControlBlock;
+            if (s.packed && s.matrix) return MatrixValue::estimatePackedFootprint(s.rows, s.cols);
+            if (s.packed && s.container) return VectorValue::estimatePackedFootprint(s.cols);
+            if (s.matrix) return MatrixValue::estimateFootprint(s.rows, s.cols, s.integer);
+            if (s.container) return VectorValue::estimateFootprint(s.cols, s.integer);
+            return sizeof(ComplexValue) + Value::kSharedControlBlock;
+        }
+
+    } // namespace
+
+    size_t estimateBinaryBytes(TokType op, const Value& left, const Value& right) {
+        const Shape a = shapeOf(left), b = shapeOf(right);
+        Shape s;
+        if (a.disk || b.disk) {
+            s.disk = true;
+        }
+        else if (op == TokType::Caret) {
+            s = a;
+        }
+        else if (op == TokType::Star && a.matrix && b.container) {
+            // произведение матриц / матрицы на вектор
+            s.rows = b.matrix ? a.rows : 1;
+            s.cols = b.matrix ? b.cols : a.rows;
+            s.container = true;
+            s.matrix = b.matrix;
+            s.integer = a.integer && b.integer;
+            s.packed = packedResult(a, b);
+        }
+        else {
+            // поэлементные операции и умножение на скаляр (с расширением)
+            s.rows = std::max(a.rows, b.rows);
+            s.cols = std::max(a.cols, b.cols);
+            s.container = a.container || b.container;
+            s.matrix = a.matrix || b.matrix;
+            s.integer = a.integer && b.integer && op != TokType::Slash && op != TokType::DotSlash;
+            s.packed = packedResult(a, b);
+        }
+        return bytesFor(s);
+    }
+
+    size_t estimateNegateBytes(const Value& v) {
+        return bytesFor(shapeOf(v));
+    }
+
+    size_t estimateCallBytes(const std::string& name, const std::vector<ValuePtr>& args) {
+        auto b = findBuiltin(name);
+        if (!b || args.empty() || b->size == ResultSize::Scalar) return bytesFor(Shape{});
+        Shape s = shapeOf(*(b->size == ResultSize::BoxedLikeLast ? args.back() : args.front()));
+        if (b->size != ResultSize::LikeArg) s.integer = s.packed = s.disk = false;
+        return bytesFor(s);
+    }
+
+    ValuePtr makeMatrixLiteral(std::vector<std::vector<ValuePtr>> rows) {
+        for (auto& r : rows)
+            for (auto& v : r)
+                if (!isScalar(v->kind())) throw EvalError("Элемент вектора/матрицы должен быть скаляром.");
+
+        if (rows.empty()) throw EvalError("Пустой литерал матрицы/вектора.");
+
+        // Если одна строка — это вектор
+        if (rows.size() == 1) {
+            return std::make_shared<VectorValue>(std::move(rows[0]));
+        }
+        return std::make_shared<MatrixValue>(std::move(rows));
+    }
+
+} // namespace mathcore
@@ -0,0 +1,133 @@
+﻿#include "pch.h"
+#include "MathCore/Optimizer.h"
+#include "MathCore/Operations.h"
+#include "MathCore/RationalValue.h"
+#include "MathCore/VectorMatrix.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace mathcore {
+
+    namespace {
+
+        constexpr size_t kMaxFoldBytes = size_t(1) << 20; // сворачиваем только небольшие результаты
+
+        class Optimizer {
+        public:
+            explicit Optimizer(NumericMode mode) : m_fast(mode == NumericMode::Fast) {}
+            NodePtr run(const NodePtr& n) { return visit(n); }
+            size_t slots() const { return m_slots; }
+
+        private:
+            std::shared_ptr<Node> visit(const NodePtr& n) {
+                auto out = std::make_shared<Node>(*n);
+                for (auto& a : out->args) a = visit(a);
+
+                // Ключ берётся до свёртки: одинаковые константные выражения
+                // сворачиваются один раз и дают один и тот же литерал.
+                auto res = m_table.emplace(keyOf(*out), out);
+                if (!res.second) {
+                    auto& existing = res.first->second;
+                    // Повтор: вычислять стоит один раз, если это не лист.
+                    if (existing->slot < 0 && existing->kind != NodeKind::Literal && existing->kind != NodeKind::Variable)
+                        existing->slot = static_cast<int>(m_slots++);
+                    return existing;
+                }
+                // В режиме fast вычислитель читает литералы неточными: свёртка тоже
+                if (m_fast && out->kind == NodeKind::Literal) out->value = toInexact(out->value);
+                fold(*out);
+                return out;
+            }
+
+            static bool allLiteral(const Node& n) {
+                for (auto& a : n.args)
+                    if (a->kind != NodeKind::Literal) return false;
+                return true;
+            }
+
+            // Заменяет узел литералом, если все операнды — константы.
+            void fold(Node& n) const {
+                if (n.kind == NodeKind::Literal || n.kind == NodeKind::Variable || !allLiteral(n)) return;
+                if (n.kind == NodeKind::Call && !isBuiltinFunction(n.name)) return;
+
+                ValuePtr v;
+                try {
+                    switch (n.kind) {
+                    case NodeKind::Negate:
+                        v = negate(*n.args[0]->value);
+                        break;
+                    case NodeKind::Binary:
+                        // Крупные результаты (например, внешнее произведение литералов через
+                        // '.*') не сворачиваем: вычислитель проверит их по лимиту памяти.
+                        if (estimateBinaryBytes(n.op, *n.args[0]->value, *n.args[1]->value) > kMaxFoldBytes) return;
+                        v = binaryOp(n.op, *n.args[0]->value, *n.args[1]->value);
+                        break;
+                    case NodeKind::Call: {
+                        std::vector<ValuePtr> args;
+                        for (auto& a : n.args) args.push_back(a->value);
+                        if (estimateCallBytes(n.name, args) > kMaxFoldBytes) return;
+                        v = callBuiltin(n.name, args);
+                        break;
+                    }
+                    case NodeKind::MatrixLit: {
+                        std::vector<std::vector<ValuePtr>> rows;
+                        size_t k = 0;
+                        for (size_t len : n.rowSizes) {
+                            rows.emplace_back();
+                            for (size_t j = 0; j < len; ++j) rows.back().push_back(n.args[k++]->value);
+                        }
+                        v = makeMatrixLiteral(std::move(rows));
+                        break;
+                    }
+                    default:
+                        return;
+                    }
+                }
+                catch (const std::exception&) {
+                    return; // ошибку сообщит вычисление
+                }
+
+                n.kind = NodeKind::Literal;
+                n.value = m_fast ? toInexact(v) : std::move(v);
+                n.args.clear();
+                n.rowSizes.clear();
+                n.name.clear();
+            }
+
+            // Структурный ключ узла. Дочерние узлы уже объединены, поэтому
+            // достаточно их адресов.
+            static std::string keyOf(const Node& n) {
+                std::string k = std::to_string(static_cast<int>(n.kind)) + ':' + std::to_string(static_cast<int>(n.op)) + ':';
+                if (n.kind == NodeKind::Literal) {
+                    if (n.value->kind() == ValueKind::Rational) {
+                        auto& r = static_cast<const RationalValue&>(*n.value);
+                        k += 'R' + std::to_string(r.num()) + '/' + std::to_string(r.den());
+                    }
+                    else {
+                        k += 'P' + std::to_string(reinterpret_cast<uintptr_t>(n.value.get()));
+                    }
+                    return k;
+                }
+                k += n.name;
+                for (auto& a : n.args) k += ',' + std::to_string(reinterpret_cast<uintptr_t>(a.get()));
+                k += '|';
+                for (size_t r : n.rowSizes) k += std::to_string(r) + ',';
+                return k;
+            }
+
+            std::unordered_map<std::string, std::shared_ptr<Node>> m_table;
+            size_t m_slots{ 0 };
+            bool m_fast;
+        };
+
+    } // namespace
+
+    void optimize(Statement& st, NumericMode mode) {
+        if (!st.expr) return;
+        Optimizer opt(st.mode.value_or(mode));
+        st.expr = opt.run(st.expr);
+        st.slots = opt.slots();
+    }
+
+} // namespace mathcore
@@ -0,0 +1,272 @@
+﻿#include "pch.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mathcore {
+namespace par {
+
+    namespace {
+
+        const ParallelOptions kDefaultOptions;
+        thread_local const ParallelOptions* tlOptions = nullptr;
+
+        // Одна операция parallelFor. Куски заранее поровну делятся между участниками
+        // (вызывающий и приглашённые рабочие потоки): у каждого свой диапазон [begin, end).
+        // Участник берёт куски с начала своего диапазона, а закончив, крадёт с конца чужих —
+        // так медленные куски одного участника доделывают остальные. Диапазон — одно 64-битное
+        // слово (begin и end по 32 бита), владелец и вор меняют его одним CAS.
+        // Задачи в очередях пула — лишь приглашения стать участником; опоздавшая ничего не найдёт.
+        struct Job {
+            struct alignas(64) Slot {
+                std::atomic<uint64_t> range{ 0 };
+            };
+
+            static constexpr size_t kMaxChunks = UINT32_MAX;
+
+            const std::function<void(size_t)>* body;
+            size_t chunks;
+            size_t slots;
+            std::unique_ptr<Slot[]> ranges;
+            std::atomic<size_t> joined{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::atomic<bool> failed{ false };
+            std::exception_ptr error;
+            std::mutex mx;
+            std::condition_variable finished;
+
+            Job(const std::function<void(size_t)>& b, size_t n, size_t participants)
+                : body(&b), chunks(n), slots(participants), ranges(new Slot[participants]) {
+                for (size_t s = 0; s < slots; ++s)
+                    ranges[s].range.store(pack(n * s / slots, n * (s + 1) / slots), std::memory_order_relaxed);
+            }
+
+            static uint64_t pack(uint64_t begin, uint64_t end) { return begin | (end << 32); }
+
+            // Владелец — с начала диапазона, вор — с конца.
+            bool take(size_t slot, bool steal, size_t& chunk) {
+                auto& range = ranges[slot].range;
+                uint64_t v = range.load(std::memory_order_relaxed);
+                for (;;) {
+                    const uint64_t begin = v & 0xffffffffu, end = v >> 32;
+                    if (begin >= end) return false;
+                    const uint64_t next = steal ? pack(begin, end - 1) : pack(begin + 1, end);
+                    if (range.compare_exchange_weak(v, next, std::memory_order_relaxed)) {
+                        chunk = static_cast<size_t>(steal ? end - 1 : begin);
+                        return true;
+                    }
+                }
+            }
+
+            bool next(size_t self, size_t& chunk) {
+                if (self < slots && take(self, false, chunk)) return true;
+                for (size_t k = 1; k <= slots; ++k)
+                    if (take((self + k) % slots, true, chunk)) return true;
+                return false;
+            }
+
+            // body трогается только до учёта последнего куска: после этого
+            // вызывающий может вернуться и body перестанет существовать.
+            void work() {
+                const size_t self = joined.fetch_add(1, std::memory_order_relaxed);
+                for (size_t c; next(self, c);) {
+                    if (!failed.load(std::memory_order_relaxed)) {
+                        try {
+                            (*body)(c);
+                        }
+                        catch (...) {
+                            std::lock_guard<std::mutex> lk(mx);
+                            if (!error) error = std::current_exception();
+                            failed = true;
+                        }
+                    }
+                    if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == chunks) {
+                        std::lock_guard<std::mutex> lk(mx);
+                        finished.notify_all();
+                    }
+                }
+            }
+
+            void wait() {
+                std::unique_lock<std::mutex> lk(mx);
+                finished.wait(lk, [this] { return done.load(std::memory_order_acquire) == chunks; });
+            }
+        };
+
+        using Task = std::shared_ptr<Job>;
+
+        class ThreadPool {
+        public:
+            explicit ThreadPool(unsigned workers) : m_queues(workers) {
+                for (auto& q : m_queues) q = std::make_unique<Queue>();
+                m_threads.reserve(workers);
+                for (unsigned i = 0; i < workers; ++i) m_threads.emplace_back([this, i] { loop(i); });
+            }
+
+            ~ThreadPool() {
+                {
+                    std::lock_guard<std::mutex> lk(m_sleepMx);
+                    m_stop = true;
+                }
+                m_wake.notify_all();
+                for (auto& t : m_threads) t.join();
+            }
+
+            unsigned workers() const { return static_cast<unsigned>(m_threads.size()); }
+
+            // Раскладывает count приглашений по очередям: из рабочего потока — в свою
+            // очередь (её разберут соседи), из внешнего — по кругу.
+            void submit(const Task& task, unsigned count) {
+                const size_t n = m_queues.size();
+                size_t q = tlWorker >= 0 && tlPool == this ? static_cast<size_t>(tlWorker)
+                    : m_nextQueue.fetch_add(1, std::memory_order_relaxed);
+                for (unsigned k = 0; k < count; ++k, ++q) {
+                    auto& queue = *m_queues[q % n];
+                    std::lock_guard<std::mutex> lk(queue.mx);
+                    queue.tasks.push_back(task);
+                }
+                m_pending.fetch_add(count, std::memory_order_release);
+                {
+                    std::lock_guard<std::mutex> lk(m_sleepMx);
+                }
+                if (count == 1) m_wake.notify_one();
+                else m_wake.notify_all();
+            }
+
+        private:
+            struct Queue {
+                std::mutex mx;
+                std::deque<Task> tasks;
+            };
+
+            // Своя очередь — с конца (свежие задачи), чужая — с начала.
+            bool take(size_t self, Task& task) {
+                const size_t n = m_queues.size();
+                for (size_t k = 0; k < n; ++k) {
+                    auto& queue = *m_queues[(self + k) % n];
+                    std::lock_guard<std::mutex> lk(queue.mx);
+                    if (queue.tasks.empty()) continue;
+                    if (k == 0) { task = std::move(queue.tasks.back()); queue.tasks.pop_back(); }
+                    else { task = std::move(queue.tasks.front()); queue.tasks.pop_front(); }
+                    m_pending.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            }
+
+            void loop(unsigned self) {
+                tlWorker = static_cast<int>(self);
+                tlPool = this;
+                for (;;) {
+                    Task task;
+                    if (take(self, task)) {
+                        task->work();
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lk(m_sleepMx);
+                    m_wake.wait(lk, [this] { return m_stop || m_pending.load(std::memory_order_acquire) > 0; });
+                    if (m_stop) return;
+                }
+            }
+
+            static thread_local int tlWorker;
+            static thread_local const ThreadPool* tlPool;
+
+            std::vector<std::unique_ptr<Queue>> m_queues;
+            std::vector<std::thread> m_threads;
+            std::atomic<size_t> m_pending{ 0 };
+            std::atomic<size_t> m_nextQueue{ 0 };
+            std::mutex m_sleepMx;
+            std::condition_variable m_wake;
+            bool m_stop{ false };
+        };
+
+        thread_local int ThreadPool::tlWorker = -1;
+        thread_local const ThreadPool* ThreadPool::tlPool = nullptr;
+
+        std::mutex g_poolMx;
+        std::shared_ptr<ThreadPool> g_pool;       // создаётся при первой параллельной операции
+        std::atomic<unsigned> g_poolSize{ 0 };    // 0 — ещё не определён
+
+        unsigned hardwareThreads() {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::shared_ptr<ThreadPool> sharedPool() {
+            std::lock_guard<std::mutex> lk(g_poolMx);
+            if (!g_pool) g_pool = std::make_shared<ThreadPool>(threadPoolSize() - 1);
+            return g_pool;
+        }
+
+    } // namespace
+
+    const ParallelOptions& options() {
+        return tlOptions ? *tlOptions : kDefaultOptions;
+    }
+
+    OptionsScope::OptionsScope(const ParallelOptions& opts) : m_prev(tlOptions) {
+        tlOptions = &opts;
+    }
+
+    OptionsScope::~OptionsScope() {
+        tlOptions = m_prev;
+    }
+
+    unsigned concurrency() {
+        const unsigned pool = threadPoolSize();
+        const unsigned wanted = options().threads;
+        return wanted ? std::min(wanted, pool) : pool;
+    }
+
+    void runChunks(size_t chunks, unsigned workers, const std::function<void(size_t)>& body) {
+        auto pool = sharedPool();
+        const cancel::Budget* budget = cancel::current();
+        const std::function<void(size_t)> limited = [&](size_t c) {
+            cancel::Scope scope(budget);
+            body(c);
+        };
+        const unsigned helpers = std::min(workers - 1, pool->workers());
+        if (chunks > Job::kMaxChunks) {
+            // Диапазон кусков не помещается в 32 бита (на практике недостижимо): без пула
+            for (size_t c = 0; c < chunks; ++c) limited(c);
+            return;
+        }
+        auto job = std::make_shared<Job>(limited, chunks, helpers + 1);
+        if (helpers) pool->submit(job, helpers);
+        job->work();
+        job->wait();
+        if (job->error) std::rethrow_exception(job->error);
+    }
+
+} // namespace par
+
+    void setThreadPoolSize(unsigned threads) {
+        std::shared_ptr<par::ThreadPool> old;
+        {
+            std::lock_guard<std::mutex> lk(par::g_poolMx);
+            par::g_poolSize = threads ? threads : par::hardwareThreads();
+            old = std::move(par::g_pool);
+        }
+        // Потоки старого пула завершаются здесь, вне блокировки
+    }
+
+    unsigned threadPoolSize() {
+        // Вызывается на каждой операции, поэтому без блокировки
+        unsigned n = par::g_poolSize.load(std::memory_order_relaxed);
+        if (!n) {
+            unsigned expected = 0;
+            n = par::hardwareThreads();
+            if (!par::g_poolSize.compare_exchange_strong(expected, n)) n = expected;
+        }
+        return n;
+    }
+
+} // namespace mathcore
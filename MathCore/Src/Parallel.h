@@ -0,0 +1,69 @@
+﻿#pragma once
+// Распараллеливание циклов для ядер MathCore на общем пуле потоков (Parallel.cpp).
+
+#include "MathCore/Parallelism.h"
+#include "Cancel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+namespace mathcore {
+namespace par {
+
+    // Настройки текущего потока: установленные OptionsScope или по умолчанию.
+    const ParallelOptions& options();
+
+    // Ставит настройки потока на время жизни объекта (вычисление строки интерпретатором).
+    class OptionsScope {
+    public:
+        explicit OptionsScope(const ParallelOptions& opts);
+        ~OptionsScope();
+        OptionsScope(const OptionsScope&) = delete;
+        OptionsScope& operator=(const OptionsScope&) = delete;
+    private:
+        const ParallelOptions* m_prev;
+    };
+
+    // Сколько потоков может занять операция: настройки потока, ограниченные размером пула.
+    unsigned concurrency();
+
+    // Порог распараллеливания ядра: grain из настроек или значение ядра по умолчанию.
+    inline size_t threshold(size_t kernelDefault) {
+        return options().grain ? options().grain : kernelDefault;
+    }
+
+    // Выполняет body(c) для всех c из [0, chunks) не более чем в workers потоках
+    // общего пула; вызывающий поток тоже берёт куски. Куски поровну делятся между
+    // потоками, освободившийся поток крадёт куски у отстающих; свободные рабочие потоки
+    // забирают и приглашения из очередей занятых. Первое исключение пробрасывается вызывающему,
+    // оставшиеся куски после него пропускаются. Рабочие потоки выполняют куски
+    // с ограничениями вызывающего (cancel::current).
+    void runChunks(size_t chunks, unsigned workers, const std::function<void(size_t)>& body);
+
+    // Вызывает body(begin, end) для кусков [0, n) длиной grain (последний может быть короче).
+    // Разбиение на куски не зависит от числа потоков, поэтому ядра, которые
+    // объединяют частичные результаты по номерам кусков, детерминированы.
+    // Перед каждым куском проверяется отмена строки (cancel::check).
+    template <class Body>
+    void parallelFor(size_t n, size_t grain, const Body& body) {
+        if (n == 0) return;
+        grain = std::max<size_t>(grain, 1);
+        const size_t chunks = (n + grain - 1) / grain;
+        const size_t threads = chunks > 1 ? std::min<size_t>(chunks, concurrency()) : 1;
+
+        if (threads <= 1) {
+            for (size_t c = 0; c < chunks; ++c) {
+                cancel::check();
+                body(c * grain, std::min(n, (c + 1) * grain));
+            }
+            return;
+        }
+        runChunks(chunks, static_cast<unsigned>(threads), [&](size_t c) {
+            cancel::check();
+            body(c * grain, std::min(n, (c + 1) * grain));
+        });
+    }
+
+} // namespace par
+} // namespace mathcore
@@ -0,0 +1,237 @@
+﻿#include "pch.h"
+#include "MathCore/Parser.h"
+#include "MathCore/RationalValue.h"
+#include "IntKernels.h"
+
+#include <cctype>
+#include <cstdint>
+
+namespace mathcore {
+
+    static std::shared_ptr<Node> makeNode(NodeKind kind, const Token& at) {
+        auto n = std::make_shared<Node>();
+        n->kind = kind;
+        n->line = at.line;
+        n->col = at.col;
+        return n;
+    }
+
+    ParseResult Parser::parseLine(const std::string& line) {
+        ParseResult res;
+        Tokenizer tz(line);
+        Parser p(tz);
+
+        if (tz.error()) { res.error = tz.error(); return res; }
+
+        // Пустая строка
+        if (tz.peek().type == TokType::End) return res;
+
+        // Директива режима: mode fast | mode exact
+        if (tz.peek().type == TokType::Ident && tz.peek().text == "mode" && tz.peek(1).type == TokType::Ident &&
+            tz.peek(2).type == TokType::End) {
+            const std::string& mode = tz.peek(1).text;
+            if (mode == "fast" || mode == "exact") {
+                res.stmt.mode = mode == "fast" ? NumericMode::Fast : NumericMode::Exact;
+                return res;
+            }
+            p.fail(tz.peek(1), ErrorCode::UnknownMode, "Неизвестный режим: ожидалось mode fast или mode exact.");
+            res.error = p.m_error;
+            return res;
+        }
+
+        // Присваивание: IDENT '=' expr
+        if (tz.peek().type == TokType::Ident && tz.peek(1).type == TokType::Equal) {
+            res.stmt.target = tz.peek().text;
+            tz.next(); // ident
+            tz.next(); // '='
+        }
+
+        auto expr = p.parseExpr();
+        if (expr && tz.peek().type != TokType::End)
+            p.fail(tz.peek(), ErrorCode::TrailingTokens, "Лишние токены в конце строки.");
+
+        // Ошибка токенизатора «обрезает» поток токенов — сообщаем о ней, а не о последствиях.
+        if (tz.error()) res.error = tz.error();
+        else if (p.m_error) res.error = p.m_error;
+        else res.stmt.expr = std::move(expr);
+        return res;
+    }
+
+    NodePtr Parser::fail(const Token& at, ErrorCode code, const char* msg) {
+        if (!m_error) m_error = Diagnostic{ code, at.line, at.col, msg };
+        return nullptr;
+    }
+
+    bool Parser::expect(TokType t, ErrorCode code, const char* msg) {
+        if (m_tz.match(t)) return true;
+        fail(m_tz.peek(), code, msg);
+        return false;
+    }
+
+    // expr := term (('+'|'-') term)*
+    NodePtr Parser::parseExpr() {
+        auto left = parseTerm();
+        while (left) {
+            const Token t = m_tz.peek();
+            if (t.type != TokType::Plus && t.type != TokType::Minus) break;
+            m_tz.next();
+            auto right = parseTerm();
+            if (!right) return nullptr;
+            auto n = makeNode(NodeKind::Binary, t);
+            n->op = t.type;
+            n->args = { left, right };
+            left = n;
+        }
+        return left;
+    }
+
+    // term := factor (('*'|'/'|'.*'|'./') factor)*
+    NodePtr Parser::parseTerm() {
+        auto left = parseFactor();
+        while (left) {
+            const Token t = m_tz.peek();
+            if (t.type != TokType::Star && t.type != TokType::Slash &&
+                t.type != TokType::DotStar && t.type != TokType::DotSlash) break;
+            m_tz.next();
+            auto right = parseFactor();
+            if (!right) return nullptr;
+            auto n = makeNode(NodeKind::Binary, t);
+            n->op = t.type;
+            n->args = { left, right };
+            left = n;
+        }
+        return left;
+    }
+
+    // factor := '-' factor | power
+    NodePtr Parser::parseFactor() {
+        const Token t = m_tz.peek();
+        if (m_tz.match(TokType::Minus)) {
+            auto v = parseFactor();
+            if (!v) return nullptr;
+            auto n = makeNode(NodeKind::Negate, t);
+            n->args = { v };
+            return n;
+        }
+        return parsePower();
+    }
+
+    // power := primary ('^' factor)?
+    // Правоассоциативно: 2^3^2 = 2^(3^2); -2^2 = -(2^2); показатель может быть отрицательным: 2^-1.
+    NodePtr Parser::parsePower() {
+        auto base = parsePrimary();
+        if (!base) return nullptr;
+        const Token t = m_tz.peek();
+        if (!m_tz.match(TokType::Caret)) return base;
+
+        auto exponent = parseFactor();
+        if (!exponent) return nullptr;
+        auto n = makeNode(NodeKind::Binary, t);
+        n->op = TokType::Caret;
+        n->args = { base, exponent };
+        return n;
+    }
+
+    NodePtr Parser::parsePrimary() {
+        const Token t = m_tz.peek();
+
+        if (m_tz.match(TokType::Number)) {
+            return parseNumber(t);
+        }
+
+        // Числовой литерал [ ... ], уже собранный токенизатором в вектор/матрицу
+        if (m_tz.match(TokType::Literal)) {
+            auto n = makeNode(NodeKind::Literal, t);
+            n->value = t.value;
+            return n;
+        }
+
+        if (m_tz.match(TokType::String)) {
+            auto n = makeNode(NodeKind::Text, t);
+            n->name = t.text;
+            return n;
+        }
+
+        if (m_tz.match(TokType::Ident)) {
+            // function call: IDENT '(' expr ')'
+            if (m_tz.peek().type == TokType::LParen) {
+                return parseFunctionCall(t);
+            }
+
+            auto n = makeNode(NodeKind::Variable, t);
+            n->name = t.text;
+            return n;
+        }
+
+        if (m_tz.match(TokType::LParen)) {
+            auto v = parseExpr();
+            if (!v) return nullptr;
+            if (!expect(TokType::RParen, ErrorCode::ExpectedRParen, "Ожидалась ')'.")) return nullptr;
+            return v;
+        }
+
+        if (m_tz.match(TokType::LBracket)) {
+            return parseVectorOrMatrix(t);
+        }
+
+        return fail(t, ErrorCode::ExpectedExpression, "Ожидалось выражение.");
+    }
+
+    NodePtr Parser::parseFunctionCall(const Token& nameTok) {
+        // IDENT '(' expr (',' expr)* ')'
+        if (!expect(TokType::LParen, ErrorCode::ExpectedLParen, "Ожидалась '('.")) return nullptr;
+        auto n = makeNode(NodeKind::Call, nameTok);
+        n->name = nameTok.text;
+        do {
+            auto arg = parseExpr();
+            if (!arg) return nullptr;
+            n->args.push_back(std::move(arg));
+        } while (m_tz.match(TokType::Comma));
+        if (!expect(TokType::RParen, ErrorCode::ExpectedRParen, "Ожидалась ')'.")) return nullptr;
+        return n;
+    }
+
+    NodePtr Parser::parseNumber(const Token& tok) {
+        // Поддержка десятичных как рациональных: 3.25 = 325/100 -> 13/4
+        int64_t num, den;
+        if (!intk::parseDecimal(tok.text.data(), tok.text.size(), num, den))
+            return fail(tok, ErrorCode::InvalidNumber, "Некорректное число.");
+        auto n = makeNode(NodeKind::Literal, tok);
+        n->value = RationalValue::create(num, den);
+        return n;
+    }
+
+    NodePtr Parser::parseVectorOrMatrix(const Token& open) {
+        // Внутри: элементы разделяются пробелами, строки матрицы отделяются ';'
+        // Пример: [ 1 0; 0 1 ]
+        // Закрывающая ']' уже НЕ съедена (мы съели '[' до вызова)
+        auto n = makeNode(NodeKind::MatrixLit, open);
+        std::vector<NodePtr> items;
+        std::vector<size_t> rowSizes{ 0 };
+
+        while (true) {
+            if (m_tz.peek().type == TokType::RBracket) {
+                m_tz.next(); // ]
+                break;
+            }
+
+            if (m_tz.match(TokType::Semicolon)) {
+                rowSizes.push_back(0);
+                continue;
+            }
+
+            auto v = parseExpr();
+            if (!v) return nullptr;
+            items.push_back(std::move(v));
+            ++rowSizes.back();
+        }
+
+        // Удалим возможную пустую последнюю строку
+        if (rowSizes.back() == 0) rowSizes.pop_back();
+
+        n->args = std::move(items);
+        n->rowSizes = std::move(rowSizes);
+        return n;
+    }
+
+} // namespace mathcore
@@ -0,0 +1,85 @@
+﻿#pragma once
+// Точная сумма рациональных чисел и их произведений по общему знаменателю: без
+// создания промежуточных RationalValue и с одним сокращением в конце (или при
+// угрозе переполнения). Используется свёртками и скалярными произведениями в mul.
+// Промежуточные значения — int64 с проверкой: на MSVC нет 128-битного целого.
+
+#include <cstdint>
+
+#include "MathCore/RationalValue.h"
+#include "IntKernels.h"
+
+namespace mathcore {
+
+    class RationalAccumulator {
+    public:
+        // Добавляет n/d (d > 0). Возвращает false при переполнении int64;
+        // накопленное значение при этом не меняется (может быть лишь сокращено).
+        bool add(int64_t n, int64_t d) {
+            if (tryAdd(n, d)) return true;
+            // Сокращаем и пробуем ещё раз
+            reduce(m_num, m_den);
+            reduce(n, d);
+            return tryAdd(n, d);
+        }
+
+        // Добавляет (an/ad) * (bn/bd) для несократимых дробей.
+        bool addProduct(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+            // Перекрёстное сокращение: произведение сразу несократимо. Для целых
+            // множителей (частый случай) НОД не нужен.
+            if (bd != 1) reduce(an, bd);
+            if (ad != 1) reduce(bn, ad);
+            int64_t n, d;
+            if (!intk::mulChecked(an, bn, n) || !intk::mulChecked(ad, bd, d)) return false;
+            return add(n, d);
+        }
+
+        bool merge(const RationalAccumulator& o) { return add(o.m_num, o.m_den); }
+
+        int64_t num() const { return m_num; }
+        int64_t den() const { return m_den; }
+        ValuePtr result() const { return RationalValue::create(m_num, m_den); }
+
+    private:
+        static void reduce(int64_t& n, int64_t& d) {
+            const int64_t g = static_cast<int64_t>(intk::gcd(intk::magnitude(n), static_cast<uint64_t>(d)));
+            if (g > 1) { n /= g; d /= g; }
+        }
+
+        bool tryAdd(int64_t n, int64_t d) {
+            int64_t l, a, b, s;
+            if (d == m_den) {
+                if (!intk::addChecked(m_num, n, s)) return false;
+                m_num = s;
+                return true;
+            }
+
+            // Один знаменатель делит другой — обходимся без НОД.
+            if (m_den % d == 0) {
+                if (!intk::mulChecked(n, m_den / d, b) || !intk::addChecked(m_num, b, s)) return false;
+                m_num = s;
+                return true;
+            }
+            if (d % m_den == 0) {
+                if (!intk::mulChecked(m_num, d / m_den, a) || !intk::addChecked(a, n, s)) return false;
+                m_num = s;
+                m_den = d;
+                return true;
+            }
+
+            // Общий знаменатель: lcm(m_den, d)
+            const int64_t g = static_cast<int64_t>(intk::gcd(static_cast<uint64_t>(m_den), static_cast<uint64_t>(d)));
+            if (!intk::mulChecked(m_den / g, d, l)) return false;
+            if (!intk::mulChecked(m_num, l / m_den, a)) return false;
+            if (!intk::mulChecked(n, l / d, b)) return false;
+            if (!intk::addChecked(a, b, s)) return false;
+            m_num = s;
+            m_den = l;
+            return true;
+        }
+
+        int64_t m_num{ 0 };
+        int64_t m_den{ 1 };
+    };
+
+} // namespace mathcore
@@ -1,18 +1,20 @@
 ﻿#include "pch.h"
 #include "MathCore/RationalValue.h"
 #include "MathCore/ComplexValue.h"
+#include "MathCore/VectorMatrix.h"
+#include "IntKernels.h"
 
 #include <cmath>
 
 namespace mathcore {
 
-    static int64_t abs64(int64_t x) { return x < 0 ? -x : x; }
-
     void RationalValue::normalize(int64_t& num, int64_t& den) {
         if (den == 0) throw EvalError("Деление на ноль (знаменатель равен 0).");
         if (den < 0) { den = -den; num = -num; }
-        const int64_t g = std::gcd(abs64(num), abs64(den));
-        if (g != 0) { num /= g; den /= g; }
+        if (den == 1) return;
+        // den > 0, поэтому g < 2^63 и помещается в int64
+        const int64_t g = static_cast<int64_t>(intk::gcd(intk::magnitude(num), static_cast<uint64_t>(den)));
+        if (g > 1) { num /= g; den /= g; }
     }
 
     RationalValue::RationalValue(int64_t num, int64_t den) : m_num(num), m_den(den) {
@@ -63,53 +65,70 @@ namespace mathcore {
     }
 
     ValuePtr RationalValue::add(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational) {
-            auto& r = static_cast<const RationalValue&>(rhs);
-            // a/b + c/d = (ad + cb)/bd
-            const int64_t n = m_num * r.den() + r.num() * m_den;
-            const int64_t d = m_den * r.den();
-            return RationalValue::create(n, d);
-        }
-        if (rhs.kind() == ValueKind::Complex) {
-            return ComplexValue::create(toDouble(*this), 0.0)->add(rhs);
-        }
+        if (isScalar(rhs.kind())) return scalarAdd(*this, rhs);
+        if (rhs.kind() == ValueKind::Vector || rhs.kind() == ValueKind::Matrix)
+            return elementwise(ElemOp::Add, *this, rhs, "");
         return Value::add(rhs);
     }
 
     ValuePtr RationalValue::sub(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational) {
-            auto& r = static_cast<const RationalValue&>(rhs);
-            const int64_t n = m_num * r.den() - r.num() * m_den;
-            const int64_t d = m_den * r.den();
-            return RationalValue::create(n, d);
-        }
-        if (rhs.kind() == ValueKind::Complex) {
-            return ComplexValue::create(toDouble(*this), 0.0)->sub(rhs);
-        }
+        if (isScalar(rhs.kind())) return scalarSub(*this, rhs);
+        if (rhs.kind() == ValueKind::Vector || rhs.kind() == ValueKind::Matrix)
+            return elementwise(ElemOp::Sub, *this, rhs, "");
         return Value::sub(rhs);
     }
 
     ValuePtr RationalValue::mul(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational) {
-            auto& r = static_cast<const RationalValue&>(rhs);
-            return RationalValue::create(m_num * r.num(), m_den * r.den());
-        }
-        if (rhs.kind() == ValueKind::Complex) {
-            return ComplexValue::create(toDouble(*this), 0.0)->mul(rhs);
-        }
+        if (isScalar(rhs.kind())) return scalarMul(*this, rhs);
         return Value::mul(rhs);
     }
 
     ValuePtr RationalValue::div(const Value& rhs) const {
-        if (rhs.kind() == ValueKind::Rational) {
-            auto& r = static_cast<const RationalValue&>(rhs);
-            if (r.num() == 0) throw EvalError("Деление на ноль.");
-            return RationalValue::create(m_num * r.den(), m_den * r.num());
+        if (isScalar(rhs.kind())) return scalarDiv(*this, rhs);
+        return Value::div(rhs);
+    }
+
+    ValuePtr RationalValue::pow(const Value& rhs) const {
+        if (rhs.kind() == ValueKind::Rational && static_cast<const RationalValue&>(rhs).den() == 1) {
+            // Точная целая степень бинарным возведением: O(log k) умножений.
+            // Дробь уже несократима, поэтому её степени тоже несократимы — НОД не нужен.
+            const int64_t k = static_cast<const RationalValue&>(rhs).num();
+            int64_t n = m_num, d = m_den;
+            if (k < 0) {
+                if (n == 0) throw EvalError("Деление на ноль.");
+                std::swap(n, d);
+            }
+            int64_t rn = 1, rd = 1;
+            for (uint64_t e = intk::magnitude(k); e; e >>= 1) {
+                bool ok = true;
+                if (e & 1) ok = intk::mulChecked(rn, n, rn) && intk::mulChecked(rd, d, rd);
+                if (ok && e > 1) ok = intk::mulChecked(n, n, n) && intk::mulChecked(d, d, d);
+                if (!ok) throw EvalError("Переполнение при возведении в степень.");
+            }
+            return RationalValue::create(rn, rd);
         }
-        if (rhs.kind() == ValueKind::Complex) {
-            return ComplexValue::create(toDouble(*this), 0.0)->div(rhs);
+        if (rhs.kind() == ValueKind::Rational || rhs.kind() == ValueKind::Complex) {
+            // Дробный или комплексный показатель: результат в общем случае иррационален
+            return ComplexValue::create(toDouble(*this), 0.0)->pow(rhs);
         }
-        return Value::div(rhs);
+        return Value::pow(rhs);
+    }
+
+    ValuePtr RationalValue::neg() const {
+        // -INT64_MIN не помещается в int64
+        if (m_num == INT64_MIN) throw EvalError("Переполнение при смене знака.");
+        return RationalValue::create(-m_num, m_den);
+    }
+
+    size_t RationalValue::computeHash() const {
+        // Дробь хранится несократимой, поэтому равные числа дают одинаковые (num, den).
+        return mixHash(mixHash(static_cast<size_t>(ValueKind::Rational), static_cast<uint64_t>(m_num)),
+            static_cast<uint64_t>(m_den));
+    }
+
+    bool RationalValue::sameContent(const Value& other) const {
+        auto& r = static_cast<const RationalValue&>(other);
+        return m_num == r.m_num && m_den == r.m_den;
     }
 
 } // namespace mathcore
@@ -0,0 +1,307 @@
+﻿#include "pch.h"
+#include "MathCore/Reductions.h"
+#include "MathCore/VectorMatrix.h"
+#include "IntKernels.h"
+#include "Parallel.h"
+#include "RationalAccumulator.h"
+
+#include <cmath>
+#include <complex>
+
+namespace mathcore {
+
+    namespace {
+
+        constexpr size_t kChunk = size_t(1) << 14; // элементов на кусок параллельной свёртки
+        constexpr size_t kLeaf = 128;              // лист попарного суммирования
+
+        // Элементы значения в плоском виде (построчно для матриц).
+        struct Elements {
+            size_t n{ 0 };
+            const int64_t* ints{ nullptr };   // все элементы целые
+            std::vector<const Value*> items;  // иначе — упакованные скаляры
+            bool allRational{ true };
+
+            bool rationalAt(size_t i, int64_t& num, int64_t& den) const {
+                if (ints) { num = ints[i]; den = 1; return true; }
+                if (items[i]->kind() != ValueKind::Rational) return false;
+                auto& r = static_cast<const RationalValue&>(*items[i]);
+                num = r.num();
+                den = r.den();
+                return true;
+            }
+
+            std::complex<double> complexAt(size_t i) const {
+                if (ints) return { static_cast<double>(ints[i]), 0.0 };
+                if (items[i]->kind() == ValueKind::Complex) return static_cast<const ComplexValue&>(*items[i]).value();
+                auto& r = static_cast<const RationalValue&>(*items[i]);
+                return { static_cast<double>(r.num()) / static_cast<double>(r.den()), 0.0 };
+            }
+        };
+
+        void addItem(Elements& e, const Value* x) {
+            e.items.push_back(x);
+            if (x->kind() != ValueKind::Rational) e.allRational = false;
+        }
+
+        Elements elementsOf(const Value& v, const char* fn) {
+            Elements e;
+            switch (v.kind()) {
+            case ValueKind::Rational:
+            case ValueKind::Complex:
+                addItem(e, &v);
+                break;
+            case ValueKind::Vector: {
+                auto& vec = static_cast<const VectorValue&>(v);
+                if (vec.isInteger()) { e.ints = vec.ints().data(); e.n = vec.size(); return e; }
+                e.items.reserve(vec.size());
+                for (auto& x : vec.items()) addItem(e, x.get());
+                break;
+            }
+            case ValueKind::Matrix: {
+                auto& m = static_cast<const MatrixValue&>(v);
+                if (m.isInteger()) { e.ints = m.ints().data(); e.n = m.rows() * m.cols(); return e; }
+                e.items.reserve(m.rows() * m.cols());
+                for (auto& r : m.data())
+                    for (auto& x : r) addItem(e, x.get());
+                break;
+            }
+            default:
+                throw EvalError(std::string("Функция ") + fn + " не поддерживается для данного типа.");
+            }
+            e.n = e.items.size();
+            return e;
+        }
+
+        [[noreturn]] void overflow() {
+            throw EvalError("Переполнение int64 при точном суммировании.");
+        }
+
+        // Сумма с компенсацией Ноймайера.
+        struct CompensatedSum {
+            double s{ 0.0 }, c{ 0.0 };
+            void add(double x) {
+                const double t = s + x;
+                if (std::abs(s) >= std::abs(x)) c += (s - t) + x;
+                else c += (x - t) + s;
+                s = t;
+            }
+            double value() const { return s + c; }
+        };
+
+        std::complex<double> pairwiseSum(const std::complex<double>* p, size_t n) {
+            if (n <= kLeaf) {
+                CompensatedSum re, im;
+                for (size_t i = 0; i < n; ++i) { re.add(p[i].real()); im.add(p[i].imag()); }
+                return { re.value(), im.value() };
+            }
+            const size_t h = n / 2;
+            return pairwiseSum(p, h) + pairwiseSum(p + h, n - h);
+        }
+
+        // Детерминированная сумма: куски фиксированной длины, затем попарно по номерам кусков.
+        std::complex<double> sumComplex(const std::vector<std::complex<double>>& x) {
+            if (x.size() <= kChunk) return pairwiseSum(x.data(), x.size());
+            std::vector<std::complex<double>> partial((x.size() + kChunk - 1) / kChunk);
+            par::parallelFor(x.size(), kChunk, [&](size_t b, size_t e) {
+                partial[b / kChunk] = pairwiseSum(x.data() + b, e - b);
+            });
+            return pairwiseSum(partial.data(), partial.size());
+        }
+
+        ValuePtr complexResult(std::complex<double> z) {
+            return ComplexValue::create(z.real(), z.imag());
+        }
+
+        // Точная сумма рациональных по кускам; f(i, acc) добавляет i-й член.
+        template <class AddTerm>
+        ValuePtr sumRational(size_t n, const AddTerm& addTerm) {
+            std::vector<RationalAccumulator> partial((n + kChunk - 1) / kChunk);
+            par::parallelFor(n, kChunk, [&](size_t b, size_t e) {
+                auto& acc = partial[b / kChunk];
+                for (size_t i = b; i < e; ++i)
+                    if (!addTerm(i, acc)) overflow();
+            });
+            RationalAccumulator total;
+            for (auto& p : partial)
+                if (!total.merge(p)) overflow();
+            return total.result();
+        }
+
+        // Сумма целых: если оценка |x| * n < 2^63, то без проверок (векторизуется).
+        int64_t sumInts(const int64_t* p, size_t n) {
+            if (intk::bitWidth(intk::maxMagnitude(p, n)) + intk::bitWidth(n) < 63) {
+                int64_t s = 0;
+                for (size_t i = 0; i < n; ++i) s += p[i];
+                return s;
+            }
+            int64_t s = 0;
+            for (size_t i = 0; i < n; ++i)
+                if (!intk::addChecked(s, p[i], s)) overflow();
+            return s;
+        }
+
+        ValuePtr sumElements(const Elements& e) {
+            if (e.ints) {
+                if (e.n <= kChunk) return RationalValue::create(sumInts(e.ints, e.n));
+                std::vector<int64_t> partial((e.n + kChunk - 1) / kChunk);
+                par::parallelFor(e.n, kChunk, [&](size_t b, size_t end) {
+                    partial[b / kChunk] = sumInts(e.ints + b, end - b);
+                });
+                int64_t s = 0;
+                for (int64_t x : partial)
+                    if (!intk::addChecked(s, x, s)) overflow();
+                return RationalValue::create(s);
+            }
+            if (e.allRational) {
+                return sumRational(e.n, [&](size_t i, RationalAccumulator& acc) {
+                    int64_t num = 0, den = 1;
+                    e.rationalAt(i, num, den);
+                    return acc.add(num, den);
+                });
+            }
+            std::vector<std::complex<double>> z(e.n);
+            for (size_t i = 0; i < e.n; ++i) z[i] = e.complexAt(i);
+            return complexResult(sumComplex(z));
+        }
+
+        // Сравнение несократимых дробей с положительными знаменателями.
+        int compareRational(int64_t an, int64_t ad, int64_t bn, int64_t bd) {
+            int64_t l, r;
+            if (intk::mulChecked(an, bd, l) && intk::mulChecked(bn, ad, r)) return (l > r) - (l < r);
+            const long double x = static_cast<long double>(an) / ad, y = static_cast<long double>(bn) / bd;
+            return (x > y) - (x < y);
+        }
+
+        ValuePtr extremum(const Value& v, bool wantMax, const char* fn) {
+            const Elements e = elementsOf(v, fn);
+            if (e.n == 0) throw EvalError(std::string("Функция ") + fn + ": пустой аргумент.");
+            if (!e.ints && !e.allRational) {
+                // Неточные значения (режим fast) комплексные, но с нулевой мнимой частью
+                // сравниваются по вещественной.
+                double best = 0.0;
+                for (size_t i = 0; i < e.n; ++i) {
+                    const std::complex<double> z = e.complexAt(i);
+                    if (z.imag() != 0.0)
+                        throw EvalError(std::string("Функция ") + fn + " не определена для комплексных чисел.");
+                    if (i == 0 || (wantMax ? z.real() > best : z.real() < best)) best = z.real();
+                }
+                return ComplexValue::create(best, 0.0);
+            }
+
+            if (e.ints) {
+                int64_t best = e.ints[0];
+                for (size_t i = 1; i < e.n; ++i)
+                    best = wantMax ? (e.ints[i] > best ? e.ints[i] : best) : (e.ints[i] < best ? e.ints[i] : best);
+                return RationalValue::create(best);
+            }
+
+            int64_t bn = 0, bd = 1;
+            e.rationalAt(0, bn, bd);
+            for (size_t i = 1; i < e.n; ++i) {
+                int64_t n = 0, d = 1;
+                e.rationalAt(i, n, d);
+                const int c = compareRational(n, d, bn, bd);
+                if (wantMax ? c > 0 : c < 0) { bn = n; bd = d; }
+            }
+            return RationalValue::create(bn, bd);
+        }
+
+        bool isPerfectSquare(int64_t x, int64_t& root) {
+            if (x < 0) return false;
+            const uint64_t ux = static_cast<uint64_t>(x);
+            uint64_t r = static_cast<uint64_t>(std::sqrt(static_cast<double>(x)));
+            while (r > 0 && r * r > ux) --r;
+            while ((r + 1) * (r + 1) <= ux) ++r;
+            root = static_cast<int64_t>(r);
+            return r * r == ux;
+        }
+
+    } // namespace
+
+    ValuePtr reduceSum(const Value& v) {
+        return sumElements(elementsOf(v, "sum"));
+    }
+
+    ValuePtr reduceMean(const Value& v) {
+        const Elements e = elementsOf(v, "mean");
+        if (e.n == 0) throw EvalError("Функция mean: пустой аргумент.");
+        return sumElements(e)->div(*RationalValue::create(static_cast<int64_t>(e.n)));
+    }
+
+    ValuePtr reduceMin(const Value& v) { return extremum(v, false, "min"); }
+    ValuePtr reduceMax(const Value& v) { return extremum(v, true, "max"); }
+
+    ValuePtr reduceDot(const Value& a, const Value& b) {
+        if (a.kind() != ValueKind::Vector || b.kind() != ValueKind::Vector)
+            throw EvalError("Функция dot ожидает два вектора.");
+        const Elements x = elementsOf(a, "dot"), y = elementsOf(b, "dot");
+        if (x.n != y.n) throw EvalError("Функция dot: векторы разных размеров.");
+
+        if (x.ints && y.ints) {
+            // Куски считаются int64-ядром матричного произведения (строка на столбец)
+            std::vector<int64_t> partial((x.n + kChunk - 1) / kChunk);
+            std::vector<char> ok(partial.size(), 1);
+            par::parallelFor(x.n, kChunk, [&](size_t b, size_t e) {
+                ok[b / kChunk] = intk::matMul(x.ints + b, y.ints + b, &partial[b / kChunk], 1, e - b, 1);
+            });
+            int64_t s = 0;
+            for (size_t c = 0; c < partial.size(); ++c)
+                if (!ok[c] || !intk::addChecked(s, partial[c], s)) overflow();
+            return RationalValue::create(s);
+        }
+
+        if ((x.ints || x.allRational) && (y.ints || y.allRational)) {
+            return sumRational(x.n, [&](size_t i, RationalAccumulator& acc) {
+                int64_t an = 0, ad = 1, bn = 0, bd = 1;
+                x.rationalAt(i, an, ad);
+                y.rationalAt(i, bn, bd);
+                return acc.addProduct(an, ad, bn, bd);
+            });
+        }
+
+        std::vector<std::complex<double>> z(x.n);
+        for (size_t i = 0; i < x.n; ++i) z[i] = x.complexAt(i) * y.complexAt(i);
+        return complexResult(sumComplex(z));
+    }
+
+    ValuePtr reduceNorm(const Value& v) {
+        const Elements e = elementsOf(v, "norm");
+
+        if (e.ints || e.allRational) {
+            auto sq = sumRational(e.n, [&](size_t i, RationalAccumulator& acc) {
+                int64_t n = 0, d = 1;
+                e.rationalAt(i, n, d);
+                return acc.addProduct(n, d, n, d);
+            });
+            auto& s = static_cast<const RationalValue&>(*sq);
+            int64_t rn, rd;
+            if (isPerfectSquare(s.num(), rn) && isPerfectSquare(s.den(), rd)) return RationalValue::create(rn, rd);
+            return ComplexValue::create(std::sqrt(static_cast<double>(s.num()) / static_cast<double>(s.den())), 0.0);
+        }
+
+        std::vector<std::complex<double>> z(e.n);
+        for (size_t i = 0; i < e.n; ++i) z[i] = std::norm(e.complexAt(i));
+        return ComplexValue::create(std::sqrt(sumComplex(z).real()), 0.0);
+    }
+
+    ValuePtr reduceTrace(const Value& m) {
+        if (m.kind() != ValueKind::Matrix) throw EvalError("Функция trace ожидает матрицу.");
+        auto& mat = static_cast<const MatrixValue&>(m);
+        if (mat.rows() != mat.cols()) throw EvalError("Функция trace: матрица должна быть квадратной.");
+
+        const size_t n = mat.rows();
+        if (mat.isInteger()) {
+            int64_t s = 0;
+            for (size_t i = 0; i < n; ++i)
+                if (!intk::addChecked(s, mat.ints()[i * n + i], s)) overflow();
+            return RationalValue::create(s);
+        }
+
+        Elements diag;
+        for (size_t i = 0; i < n; ++i) addItem(diag, mat.data()[i][i].get());
+        diag.n = n;
+        return sumElements(diag);
+    }
+
+} // namespace mathcore
@@ -0,0 +1,196 @@
+﻿#pragma once
+// Ядра для квадратных матриц N x N с N = 2..4, развёрнутые на этапе компиляции:
+// произведение, матрица на вектор, транспонирование, определитель и присоединённая
+// матрица (для обратной). Данные — построчно во временных std::array на стеке.
+// Элементы: int64 (с проверкой переполнения) или std::complex<double>.
+
+#include <array>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "MathCore/Value.h"
+#include "IntKernels.h"
+
+namespace mathcore {
+
+    class MatrixValue;
+
+namespace small {
+
+    constexpr size_t kMinN = 2;
+    constexpr size_t kMaxN = 4;
+
+    template <class T, size_t N>
+    using Mat = std::array<T, N * N>;
+
+    template <class F, size_t... I>
+    inline void unrollImpl(F& f, std::index_sequence<I...>) {
+        (f(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    // f(0), f(1), ..., f(N-1) с номером как константой времени компиляции.
+    template <size_t N, class F>
+    inline void unroll(F&& f) {
+        unrollImpl(f, std::make_index_sequence<N>{});
+    }
+
+    // Вызывает f(integral_constant<N>) для n из 2..4; false, если размер не поддерживается
+    // или f вернула false.
+    template <class F>
+    inline bool dispatch(size_t n, F&& f) {
+        switch (n) {
+        case 2: return f(std::integral_constant<size_t, 2>{});
+        case 3: return f(std::integral_constant<size_t, 3>{});
+        case 4: return f(std::integral_constant<size_t, 4>{});
+        default: return false;
+        }
+    }
+
+    // Арифметика элементов. CheckedInt копит флаг переполнения, чтобы ядра
+    // оставались без ветвлений; результат при !ok не используется.
+    struct CheckedInt {
+        using T = int64_t;
+        bool ok{ true };
+        T mul(T a, T b) { T r; ok &= intk::mulChecked(a, b, r); return r; }
+        T add(T a, T b) { T r; ok &= intk::addChecked(a, b, r); return r; }
+        T sub(T a, T b) { T r; ok &= intk::subChecked(a, b, r); return r; }
+    };
+
+    struct Complex {
+        using T = std::complex<double>;
+        bool ok{ true };
+        T mul(T a, T b) { return a * b; }
+        T add(T a, T b) { return a + b; }
+        T sub(T a, T b) { return a - b; }
+    };
+
+    // out = a * b
+    template <size_t N, class A>
+    inline void mul(const typename A::T* a, const typename A::T* b, typename A::T* out, A& ar) {
+        unroll<N>([&](auto i) {
+            unroll<N>([&](auto j) {
+                auto acc = ar.mul(a[i * N], b[j]);
+                unroll<N - 1>([&](auto k) { acc = ar.add(acc, ar.mul(a[i * N + k + 1], b[(k + 1) * N + j])); });
+                out[i * N + j] = acc;
+            });
+        });
+    }
+
+    // out = a * x
+    template <size_t N, class A>
+    inline void matVec(const typename A::T* a, const typename A::T* x, typename A::T* out, A& ar) {
+        unroll<N>([&](auto i) {
+            auto acc = ar.mul(a[i * N], x[0]);
+            unroll<N - 1>([&](auto k) { acc = ar.add(acc, ar.mul(a[i * N + k + 1], x[k + 1])); });
+            out[i] = acc;
+        });
+    }
+
+    template <size_t N, class T>
+    inline void transpose(const T* a, T* out) {
+        unroll<N>([&](auto i) {
+            unroll<N>([&](auto j) { out[j * N + i] = a[i * N + j]; });
+        });
+    }
+
+    // Определитель и присоединённая матрица: adj(a) * a = det(a) * E, поэтому
+    // a^-1 = adj / det. Формулы через миноры 2x2 (для N = 4 — разложение Лапласа
+    // по двум верхним и двум нижним строкам).
+    template <size_t N, class A>
+    inline typename A::T det(const typename A::T* a, A& ar) {
+        if constexpr (N == 2) {
+            return ar.sub(ar.mul(a[0], a[3]), ar.mul(a[1], a[2]));
+        }
+        else if constexpr (N == 3) {
+            const auto c0 = ar.sub(ar.mul(a[4], a[8]), ar.mul(a[5], a[7]));
+            const auto c1 = ar.sub(ar.mul(a[5], a[6]), ar.mul(a[3], a[8]));
+            const auto c2 = ar.sub(ar.mul(a[3], a[7]), ar.mul(a[4], a[6]));
+            return ar.add(ar.add(ar.mul(a[0], c0), ar.mul(a[1], c1)), ar.mul(a[2], c2));
+        }
+        else {
+            static_assert(N == 4, "поддерживаются только N = 2..4");
+            const auto s0 = ar.sub(ar.mul(a[0], a[5]), ar.mul(a[4], a[1]));
+            const auto s1 = ar.sub(ar.mul(a[0], a[6]), ar.mul(a[4], a[2]));
+            const auto s2 = ar.sub(ar.mul(a[0], a[7]), ar.mul(a[4], a[3]));
+            const auto s3 = ar.sub(ar.mul(a[1], a[6]), ar.mul(a[5], a[2]));
+            const auto s4 = ar.sub(ar.mul(a[1], a[7]), ar.mul(a[5], a[3]));
+            const auto s5 = ar.sub(ar.mul(a[2], a[7]), ar.mul(a[6], a[3]));
+            const auto c5 = ar.sub(ar.mul(a[10], a[15]), ar.mul(a[14], a[11]));
+            const auto c4 = ar.sub(ar.mul(a[9], a[15]), ar.mul(a[13], a[11]));
+            const auto c3 = ar.sub(ar.mul(a[9], a[14]), ar.mul(a[13], a[10]));
+            const auto c2 = ar.sub(ar.mul(a[8], a[15]), ar.mul(a[12], a[11]));
+            const auto c1 = ar.sub(ar.mul(a[8], a[14]), ar.mul(a[12], a[10]));
+            const auto c0 = ar.sub(ar.mul(a[8], a[13]), ar.mul(a[12], a[9]));
+            auto d = ar.sub(ar.mul(s0, c5), ar.mul(s1, c4));
+            d = ar.add(d, ar.mul(s2, c3));
+            d = ar.add(d, ar.mul(s3, c2));
+            d = ar.sub(d, ar.mul(s4, c1));
+            return ar.add(d, ar.mul(s5, c0));
+        }
+    }
+
+    template <size_t N, class A>
+    inline void adjugate(const typename A::T* a, typename A::T* out, A& ar) {
+        if constexpr (N == 2) {
+            out[0] = a[3];
+            out[1] = ar.sub(typename A::T{}, a[1]);
+            out[2] = ar.sub(typename A::T{}, a[2]);
+            out[3] = a[0];
+        }
+        else if constexpr (N == 3) {
+            // out[j][i] = алгебраическое дополнение a[i][j]
+            const auto m = [&](size_t r0, size_t c0, size_t r1, size_t c1) {
+                return ar.sub(ar.mul(a[r0 * 3 + c0], a[r1 * 3 + c1]), ar.mul(a[r0 * 3 + c1], a[r1 * 3 + c0]));
+            };
+            out[0] = m(1, 1, 2, 2); out[1] = m(0, 2, 2, 1); out[2] = m(0, 1, 1, 2);
+            out[3] = m(1, 2, 2, 0); out[4] = m(0, 0, 2, 2); out[5] = m(0, 2, 1, 0);
+            out[6] = m(1, 0, 2, 1); out[7] = m(0, 1, 2, 0); out[8] = m(0, 0, 1, 1);
+        }
+        else {
+            static_assert(N == 4, "поддерживаются только N = 2..4");
+            const auto s0 = ar.sub(ar.mul(a[0], a[5]), ar.mul(a[4], a[1]));
+            const auto s1 = ar.sub(ar.mul(a[0], a[6]), ar.mul(a[4], a[2]));
+            const auto s2 = ar.sub(ar.mul(a[0], a[7]), ar.mul(a[4], a[3]));
+            const auto s3 = ar.sub(ar.mul(a[1], a[6]), ar.mul(a[5], a[2]));
+            const auto s4 = ar.sub(ar.mul(a[1], a[7]), ar.mul(a[5], a[3]));
+            const auto s5 = ar.sub(ar.mul(a[2], a[7]), ar.mul(a[6], a[3]));
+            const auto c5 = ar.sub(ar.mul(a[10], a[15]), ar.mul(a[14], a[11]));
+            const auto c4 = ar.sub(ar.mul(a[9], a[15]), ar.mul(a[13], a[11]));
+            const auto c3 = ar.sub(ar.mul(a[9], a[14]), ar.mul(a[13], a[10]));
+            const auto c2 = ar.sub(ar.mul(a[8], a[15]), ar.mul(a[12], a[11]));
+            const auto c1 = ar.sub(ar.mul(a[8], a[14]), ar.mul(a[12], a[10]));
+            const auto c0 = ar.sub(ar.mul(a[8], a[13]), ar.mul(a[12], a[9]));
+            // s = x*y + z*w - u*v со знаками по формуле обращения 4x4
+            const auto t3 = [&](auto x, auto y, auto z, auto w, auto u, auto v) {
+                return ar.add(ar.sub(ar.mul(x, y), ar.mul(z, w)), ar.mul(u, v));
+            };
+            const auto neg = [&](auto x) { return ar.sub(typename A::T{}, x); };
+            out[0] = t3(a[5], c5, a[6], c4, a[7], c3);
+            out[1] = neg(t3(a[1], c5, a[2], c4, a[3], c3));
+            out[2] = t3(a[13], s5, a[14], s4, a[15], s3);
+            out[3] = neg(t3(a[9], s5, a[10], s4, a[11], s3));
+            out[4] = neg(t3(a[4], c5, a[6], c2, a[7], c1));
+            out[5] = t3(a[0], c5, a[2], c2, a[3], c1);
+            out[6] = neg(t3(a[12], s5, a[14], s2, a[15], s1));
+            out[7] = t3(a[8], s5, a[10], s2, a[11], s1);
+            out[8] = t3(a[4], c4, a[5], c2, a[7], c0);
+            out[9] = neg(t3(a[0], c4, a[1], c2, a[3], c0));
+            out[10] = t3(a[12], s4, a[13], s2, a[15], s0);
+            out[11] = neg(t3(a[8], s4, a[9], s2, a[11], s0));
+            out[12] = neg(t3(a[4], c3, a[5], c1, a[6], c0));
+            out[13] = t3(a[0], c3, a[1], c1, a[2], c0);
+            out[14] = neg(t3(a[12], s3, a[13], s1, a[14], s0));
+            out[15] = t3(a[8], s3, a[9], s1, a[10], s0);
+        }
+    }
+
+    // Обратная квадратной матрицы 2..4 через присоединённую: целая — точно (дроби
+    // adj / det), комплексная — в double. nullptr, если ядро не подходит.
+    // Бросает EvalError для вырожденной матрицы. Определена в VectorMatrix.cpp.
+    ValuePtr inverse(const MatrixValue& m);
+
+} // namespace small
+} // namespace mathcore
@@ -1,5 +1,9 @@
 ﻿#include "pch.h"
 #include "MathCore/Tokenizer.h"
+#include "MathCore/RationalValue.h"
+#include "MathCore/VectorMatrix.h"
+#include "IntKernels.h"
+
 #include <cctype>
 
 namespace mathcore {
@@ -9,7 +13,137 @@ namespace mathcore {
     }
 
     void Tokenizer::push(TokType t, std::string text, int line, int col) {
-        m_tokens.push_back(Token{ t, std::move(text), line, col });
+        m_tokens.push_back(Token{ t, std::move(text), line, col, nullptr });
+    }
+
+    bool Tokenizer::isElementwiseOp(size_t i) const {
+        return i + 1 < m_src.size() && m_src[i] == '.' && (m_src[i + 1] == '*' || m_src[i + 1] == '/');
+    }
+
+    // Быстрый путь для литералов из одних чисел ("[ 1 2.5; 3 4 ]"): символы с позиции '['
+    // за один проход читаются прямо в хранилище вектора/матрицы — без токенов на элементы,
+    // рекурсии разбора и упаковки целых. Если встречается что-то кроме чисел, минусов, пробелов
+    // и ';' (выражения, ошибки, неровные строки), возвращает false, ничего не меняя:
+    // литерал разбирается обычным путём, и семантика ошибок не отличается.
+    // Минус — по правилу парсера (элемент — выражение): в начале строки матрицы он унарный
+    // ("[ -1 2 ]"), а после элемента — вычитание из него ("[ 1 -2 3 ]" = "[ (1 - 2) 3 ]");
+    // следующие за ним минусы снова унарные.
+    bool Tokenizer::scanNumericLiteral(size_t& i, int line, int& col) {
+        const std::string& s = m_src;
+        std::vector<int64_t> ints;
+        std::vector<ValuePtr> boxed;  // с первого нецелого элемента
+        size_t rows = 0, cols = 0, inRow = 0;
+        size_t j = i + 1;
+
+        auto endRow = [&] {
+            if (rows == 0) cols = inRow;
+            else if (inRow != cols) return false;
+            ++rows;
+            inRow = 0;
+            return true;
+        };
+
+        for (;;) {
+            if (j >= s.size()) return false;
+            const char c = s[j];
+            if (c == ' ' || c == '\t' || c == '\r') { ++j; continue; }
+            if (c == ']') {
+                // Пустая последняя строка ("[ 1 2; ]") отбрасывается, как в парсере
+                if (inRow && !endRow()) return false;
+                ++j;
+                break;
+            }
+            if (c == ';') {
+                if (!inRow || !endRow()) return false;
+                ++j;
+                continue;
+            }
+
+            bool subtract = false, negative = false;
+            if (c == '-') {
+                if (inRow) { subtract = true; ++j; }
+                for (; j < s.size(); ++j) {
+                    if (s[j] == '-') negative = !negative;
+                    else if (s[j] != ' ' && s[j] != '\t' && s[j] != '\r') break;
+                }
+                if (j >= s.size()) return false;
+            }
+
+            // Границы числа — как у лексера ниже; за числом обязан идти разделитель
+            const size_t b = j;
+            bool seenDot = false;
+            if (s[j] == '.') { seenDot = true; ++j; }
+            while (j < s.size() && std::isdigit(static_cast<unsigned char>(s[j]))) ++j;
+            if (j < s.size() && s[j] == '.' && !seenDot && !isElementwiseOp(j)) {
+                ++j;
+                while (j < s.size() && std::isdigit(static_cast<unsigned char>(s[j]))) ++j;
+            }
+            if (j == b || (j - b == 1 && seenDot)) return false;
+            if (j < s.size() && s[j] != ' ' && s[j] != '\t' && s[j] != '\r' && s[j] != ';' && s[j] != ']' &&
+                s[j] != '-') return false;
+
+            int64_t num, den;
+            if (!intk::parseDecimal(s.data() + b, j - b, num, den)) return false;
+            if (negative) num = -num;
+            if (subtract) {
+                // a/b - c/d = (ad - cb)/bd, как RationalValue::sub; переполнение — обычным путём
+                int64_t ln = 1, ld = 1;
+                if (boxed.empty()) ln = ints.back();
+                else {
+                    auto& last = static_cast<const RationalValue&>(*boxed.back());
+                    ln = last.num();
+                    ld = last.den();
+                }
+                int64_t p, q;
+                if (!intk::mulChecked(ln, den, p) || !intk::mulChecked(num, ld, q) ||
+                    !intk::subChecked(p, q, num) || !intk::mulChecked(ld, den, den)) return false;
+                if (den != 1 && num % den == 0) { num /= den; den = 1; }
+                if (den == 1 && boxed.empty()) ints.back() = num;
+                else if (!boxed.empty()) boxed.back() = RationalValue::create(num, den);
+                else {
+                    boxed.reserve(ints.size());
+                    for (int64_t x : ints) boxed.push_back(RationalValue::create(x));
+                    ints.clear();
+                    boxed.back() = RationalValue::create(num, den);
+                }
+                continue;
+            }
+            if (den != 1 && num % den == 0) { num /= den; den = 1; }
+            if (den == 1 && boxed.empty()) {
+                ints.push_back(num);
+            }
+            else {
+                if (boxed.empty()) {
+                    boxed.reserve(ints.size() + 1);
+                    for (int64_t x : ints) boxed.push_back(RationalValue::create(x));
+                    ints.clear();
+                }
+                boxed.push_back(RationalValue::create(num, den));
+            }
+            ++inRow;
+        }
+        if (rows == 0) return false;
+
+        ValuePtr value;
+        if (boxed.empty()) {
+            if (rows == 1) value = std::make_shared<VectorValue>(std::move(ints));
+            else value = std::make_shared<MatrixValue>(rows, cols, std::move(ints));
+        }
+        else if (rows == 1) {
+            value = std::make_shared<VectorValue>(std::move(boxed));
+        }
+        else {
+            std::vector<std::vector<ValuePtr>> data(rows);
+            for (size_t r = 0; r < rows; ++r)
+                data[r].assign(std::make_move_iterator(boxed.begin() + r * cols),
+                    std::make_move_iterator(boxed.begin() + (r + 1) * cols));
+            value = std::make_shared<MatrixValue>(std::move(data));
+        }
+
+        m_tokens.push_back(Token{ TokType::Literal, "[", line, col, std::move(value) });
+        col += static_cast<int>(j - i);
+        i = j;
+        return true;
     }
 
     void Tokenizer::lex() {
@@ -23,26 +157,51 @@ namespace mathcore {
             const int startCol = col;
 
             switch (ch) {
-            case '[': push(TokType::LBracket, "[", line, startCol); ++i; ++col; continue;
+            case '[':
+                if (scanNumericLiteral(i, line, col)) continue;
+                push(TokType::LBracket, "[", line, startCol); ++i; ++col; continue;
             case ']': push(TokType::RBracket, "]", line, startCol); ++i; ++col; continue;
             case '(': push(TokType::LParen, "(", line, startCol); ++i; ++col; continue;
             case ')': push(TokType::RParen, ")", line, startCol); ++i; ++col; continue;
             case ';': push(TokType::Semicolon, ";", line, startCol); ++i; ++col; continue;
+            case ',': push(TokType::Comma, ",", line, startCol); ++i; ++col; continue;
             case '+': push(TokType::Plus, "+", line, startCol); ++i; ++col; continue;
             case '-': push(TokType::Minus, "-", line, startCol); ++i; ++col; continue;
             case '*': push(TokType::Star, "*", line, startCol); ++i; ++col; continue;
             case '/': push(TokType::Slash, "/", line, startCol); ++i; ++col; continue;
+            case '^': push(TokType::Caret, "^", line, startCol); ++i; ++col; continue;
             case '=': push(TokType::Equal, "=", line, startCol); ++i; ++col; continue;
             default: break;
             }
 
-            // number: digits [ '.' digits ]
+            // строка в кавычках (путь к файлу): до закрывающей кавычки в той же строке
+            if (ch == '"') {
+                const size_t close = m_src.find_first_of("\"\n", i + 1);
+                if (close == std::string::npos || m_src[close] != '"') {
+                    m_error = Diagnostic{ ErrorCode::InvalidCharacter, line, startCol, "Не закрыта кавычка." };
+                    break;
+                }
+                push(TokType::String, m_src.substr(i + 1, close - i - 1), line, startCol);
+                col += static_cast<int>(close + 1 - i);
+                i = close + 1;
+                continue;
+            }
+
+            // поэлементные операторы: '.*' и './'
+            if (ch == '.' && isElementwiseOp(i)) {
+                const bool star = m_src[i + 1] == '*';
+                push(star ? TokType::DotStar : TokType::DotSlash, star ? ".*" : "./", line, startCol);
+                i += 2; col += 2;
+                continue;
+            }
+
+            // number: digits [ '.' digits ]; точка перед '*' или '/' — начало оператора ("2.*x")
             if (std::isdigit(ch) || ch == '.') {
                 size_t j = i;
                 bool seenDot = false;
                 if (m_src[j] == '.') { seenDot = true; ++j; }
                 while (j < m_src.size() && std::isdigit(static_cast<unsigned char>(m_src[j]))) ++j;
-                if (j < m_src.size() && m_src[j] == '.' && !seenDot) {
+                if (j < m_src.size() && m_src[j] == '.' && !seenDot && !isElementwiseOp(j)) {
                     seenDot = true;
                     ++j;
                     while (j < m_src.size() && std::isdigit(static_cast<unsigned char>(m_src[j]))) ++j;
@@ -69,7 +228,8 @@ namespace mathcore {
                 continue;
             }
 
-            throw ParseError(line, startCol, "Недопустимый символ во входной строке.");
+            m_error = Diagnostic{ ErrorCode::InvalidCharacter, line, startCol, "Недопустимый символ во входной строке." };
+            break;
         }
 
         push(TokType::End, "", line, col);
@@ -1,6 +1,7 @@
 ﻿#include "pch.h"
 #include "MathCore/Value.h"
 #include "MathCore/Errors.h"
+#include "MathCore/VectorMatrix.h"
 
 namespace mathcore {
 
@@ -8,6 +9,36 @@ namespace mathcore {
 	ValuePtr Value::sub(const Value&) const { throw EvalError("Операция '-' не поддерживается для данных типов."); }
 	ValuePtr Value::mul(const Value&) const { throw EvalError("Операция '*' не поддерживается для данных типов."); }
 	ValuePtr Value::div(const Value&) const { throw EvalError("Операция '/' не поддерживается для данных типов."); }
+	size_t Value::hash() const {
+		size_t h = m_hash.load(std::memory_order_relaxed);
+		if (h == 0) {
+			// Гонка безопасна: все потоки посчитают одно и то же.
+			h = computeHash();
+			if (h == 0) h = 1;
+			m_hash.store(h, std::memory_order_relaxed);
+		}
+		return h;
+	}
+
+	bool Value::equals(const Value& other) const {
+		if (this == &other) return true;
+		if (kind() != other.kind() || hash() != other.hash()) return false;
+		return sameContent(other);
+	}
+
+	size_t Value::mixHash(size_t seed, uint64_t v) {
+		// splitmix64-финализатор поверх boost::hash_combine
+		v += 0x9e3779b97f4a7c15ULL;
+		v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+		v ^= v >> 31;
+		return seed ^ (static_cast<size_t>(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+	}
+
+	ValuePtr Value::emul(const Value& rhs) const { return elementwise(ElemOp::Mul, *this, rhs, "Нельзя умножить поэлементно: несовместимые размеры."); }
+	ValuePtr Value::ediv(const Value& rhs) const { return elementwise(ElemOp::Div, *this, rhs, "Нельзя разделить поэлементно: несовместимые размеры."); }
+	ValuePtr Value::neg() const { throw EvalError("Операция '-' не поддерживается для данных типов."); }
+	ValuePtr Value::pow(const Value&) const { throw EvalError("Операция '^' не поддерживается для данных типов."); }
 	ValuePtr Value::transpose() const { throw EvalError("Операция 'T' (транспонирование) не поддерживается для данного типа."); }
 
 } // namespace mathcore
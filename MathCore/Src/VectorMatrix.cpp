@@ -1,5 +1,14 @@
 ﻿#include "pch.h"
 #include "MathCore/VectorMatrix.h"
+#include "Cancel.h"
+#include "IntKernels.h"
+#include "Parallel.h"
+#include "RationalAccumulator.h"
+#include "SmallKernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 
 namespace mathcore {
 
@@ -7,57 +16,509 @@ namespace mathcore {
         if (!isScalar(v.kind())) throw EvalError("Ожидался скаляр (рациональный или комплексный).");
     }
 
+    // Целый скаляр: рациональное со знаменателем 1.
+    static bool asIntScalar(const Value& v, int64_t& out) {
+        if (v.kind() != ValueKind::Rational) return false;
+        auto& r = static_cast<const RationalValue&>(v);
+        if (r.den() != 1) return false;
+        out = r.num();
+        return true;
+    }
+
+    // Если все элементы целые — складывает их в ints.
+    static bool collectInts(const std::vector<ValuePtr>& items, std::vector<int64_t>& ints) {
+        for (auto& x : items) {
+            int64_t n;
+            if (!asIntScalar(*x, n)) { ints.clear(); return false; }
+            ints.push_back(n);
+        }
+        return true;
+    }
+
+    static std::string intsRowToString(const int64_t* p, size_t n) {
+        std::string s;
+        for (size_t i = 0; i < n; ++i) {
+            if (i) s += ' ';
+            s += std::to_string(p[i]);
+        }
+        return s;
+    }
+
+    namespace {
+
+        // С этого объёма работы (элементов результата, умножений) операция идёт на
+        // нескольких потоках общего пула; переопределяется ParallelOptions::grain.
+        constexpr size_t kParallelElems = size_t(1) << 15;
+
+        // Длина куска по строкам для ядра с work элементарными операциями на строку;
+        // маленькая задача — один кусок в текущем потоке.
+        size_t rowGrain(size_t rows, size_t work) {
+            const size_t limit = par::threshold(kParallelElems);
+            work = std::max<size_t>(work, 1);
+            if (rows * work < limit) return rows;
+            return std::max<size_t>(1, limit / work);
+        }
+
+        // Операнд поэлементной операции, приведённый к форме rows x cols
+        // (скаляр — 1x1, вектор — строка 1xN).
+        struct Operand {
+            const Value& v;
+            size_t rows{ 1 }, cols{ 1 };
+            const int64_t* ints{ nullptr };  // целое представление, если есть
+            int64_t scalarInt{ 0 };
+            bool packed{ false };            // неточное представление (complex<double> подряд)
+
+            explicit Operand(const Value& x) : v(x) {
+                if (x.kind() == ValueKind::Vector) {
+                    auto& vec = static_cast<const VectorValue&>(x);
+                    cols = vec.size();
+                    if (vec.isInteger()) ints = vec.ints().data();
+                    packed = vec.isPacked();
+                }
+                else if (x.kind() == ValueKind::Matrix) {
+                    auto& m = static_cast<const MatrixValue&>(x);
+                    rows = m.rows();
+                    cols = m.cols();
+                    if (m.isInteger()) ints = m.ints().data();
+                    packed = m.isPacked();
+                }
+                else if (asIntScalar(x, scalarInt)) {
+                    ints = &scalarInt;
+                }
+            }
+
+            // Шаги по строкам и столбцам: 0 для расширяемого измерения.
+            size_t rowStride() const { return rows == 1 ? 0 : cols; }
+            size_t colStride() const { return cols == 1 ? 0 : 1; }
+
+            // Элемент (i, j) результата в упакованном виде. Перед параллельной частью
+            // вызывается box(), чтобы ленивая упаковка не шла из потоков.
+            void box() const {
+                if (v.kind() == ValueKind::Vector) static_cast<const VectorValue&>(v).items();
+                else if (v.kind() == ValueKind::Matrix) static_cast<const MatrixValue&>(v).data();
+            }
+            const Value& at(size_t i, size_t j) const {
+                const size_t r = rows == 1 ? 0 : i, c = cols == 1 ? 0 : j;
+                if (v.kind() == ValueKind::Vector) return *static_cast<const VectorValue&>(v).items()[c];
+                if (v.kind() == ValueKind::Matrix) return *static_cast<const MatrixValue&>(v).data()[r][c];
+                return v;
+            }
+        };
+
+        ValuePtr scalarOp(ElemOp op, const Value& a, const Value& b) {
+            switch (op) {
+            case ElemOp::Add: return scalarAdd(a, b);
+            case ElemOp::Sub: return scalarSub(a, b);
+            case ElemOp::Mul: return scalarMul(a, b);
+            default:          return scalarDiv(a, b);
+            }
+        }
+
+        // Одна строка результата на целых: out[j] = a[j*sa] op b[j*sb].
+        // Сложение и вычитание собирают флаг переполнения без ветвлений; умножение
+        // идёт без проверок, если это гарантирует оценка по модулям (unchecked).
+        bool intRow(ElemOp op, const int64_t* a, size_t sa, const int64_t* b, size_t sb,
+            int64_t* out, size_t n, bool unchecked) {
+            if (op == ElemOp::Mul) {
+                if (unchecked) {
+                    for (size_t j = 0; j < n; ++j) out[j] = a[j * sa] * b[j * sb];
+                    return true;
+                }
+                for (size_t j = 0; j < n; ++j)
+                    if (!intk::mulChecked(a[j * sa], b[j * sb], out[j])) return false;
+                return true;
+            }
+            const bool minus = op == ElemOp::Sub;
+            uint64_t ovf = 0;
+            for (size_t j = 0; j < n; ++j) {
+                const uint64_t x = static_cast<uint64_t>(a[j * sa]);
+                const uint64_t y = static_cast<uint64_t>(b[j * sb]);
+                const uint64_t r = minus ? x - y : x + y;
+                out[j] = static_cast<int64_t>(r);
+                ovf |= minus ? ((x ^ y) & (x ^ r)) : ((x ^ r) & (y ^ r));
+            }
+            return (ovf >> 63) == 0;
+        }
+
+        bool negateInts(const int64_t* a, int64_t* out, size_t n) {
+            std::atomic<bool> overflow{ false };
+            par::parallelFor(n, rowGrain(n, 1), [&](size_t b, size_t e) {
+                if (!intk::negate(a + b, out + b, e - b)) overflow = true;
+            });
+            return !overflow;
+        }
+
+        // out(n x p) = a(n x m) * b(m x p) полосами по grain строк. Оценка переполнения
+        // внутри intk::matMul делается по полосе, результат от этого не зависит.
+        bool matMulRows(const int64_t* a, const int64_t* b, int64_t* out, size_t n, size_t m, size_t p, size_t grain) {
+            std::atomic<bool> overflow{ false };
+            par::parallelFor(n, grain, [&](size_t rb, size_t re) {
+                if (overflow.load(std::memory_order_relaxed)) return;
+                if (!intk::matMul(a + rb * m, b, out + rb * p, re - rb, m, p)) overflow = true;
+            });
+            return !overflow;
+        }
+
+        using cplx = std::complex<double>;
+
+        // Данные значения как complex<double> подряд: упакованные — без копирования, целые
+        // и скаляры — через копию в buf. nullptr — элементы хранятся как Value (общий путь).
+        const cplx* inexactData(const Value& v, std::vector<cplx>& buf) {
+            const std::vector<int64_t>* ints = nullptr;
+            if (v.kind() == ValueKind::Vector) {
+                auto& x = static_cast<const VectorValue&>(v);
+                if (x.isPacked()) return x.packed().data();
+                if (x.isInteger()) ints = &x.ints();
+            }
+            else if (v.kind() == ValueKind::Matrix) {
+                auto& m = static_cast<const MatrixValue&>(v);
+                if (m.isPacked()) return m.packed().data();
+                if (m.isInteger()) ints = &m.ints();
+            }
+            else if (v.kind() == ValueKind::Complex) {
+                buf.assign(1, static_cast<const ComplexValue&>(v).value());
+                return buf.data();
+            }
+            else if (v.kind() == ValueKind::Rational) {
+                auto& r = static_cast<const RationalValue&>(v);
+                buf.assign(1, cplx(static_cast<double>(r.num()) / static_cast<double>(r.den()), 0.0));
+                return buf.data();
+            }
+            if (!ints) return nullptr;
+            buf.assign(ints->begin(), ints->end());
+            return buf.data();
+        }
+
+        // out(n x p) = a(n x m) * b(m x p) полосами по grain строк. Порядок i-k-j: внутренний
+        // цикл идёт подряд по строке b и строке результата; умножение расписано по
+        // компонентам — без проверок NaN/inf в operator* у std::complex.
+        void matMulPacked(const cplx* a, const cplx* b, cplx* out, size_t n, size_t m, size_t p, size_t grain) {
+            par::parallelFor(n, grain, [&](size_t rb, size_t re) {
+                for (size_t i = rb; i < re; ++i) {
+                    double* o = reinterpret_cast<double*>(out + i * p);
+                    for (size_t k = 0; k < m; ++k) {
+                        const double xr = a[i * m + k].real(), xi = a[i * m + k].imag();
+                        const double* y = reinterpret_cast<const double*>(b + k * p);
+                        for (size_t j = 0; j < p; ++j) {
+                            o[2 * j] += xr * y[2 * j] - xi * y[2 * j + 1];
+                            o[2 * j + 1] += xr * y[2 * j + 1] + xi * y[2 * j];
+                        }
+                    }
+                }
+            });
+        }
+
+        template <class T>
+        void transposeRows(const T* a, T* out, size_t rows, size_t cols) {
+            // Куски по строкам результата: каждый поток пишет в свою полосу.
+            par::parallelFor(cols, rowGrain(cols, rows), [&](size_t jb, size_t je) {
+                for (size_t j = jb; j < je; ++j)
+                    for (size_t i = 0; i < rows; ++i)
+                        out[j * rows + i] = a[i * cols + j];
+            });
+        }
+
+    } // namespace
+
+    ValuePtr elementwise(ElemOp op, const Value& a, const Value& b, const char* shapeError) {
+        const Operand x(a), y(b);
+        if (x.rows != y.rows && x.rows != 1 && y.rows != 1) throw EvalError(shapeError);
+        if (x.cols != y.cols && x.cols != 1 && y.cols != 1) throw EvalError(shapeError);
+
+        const bool toMatrix = a.kind() == ValueKind::Matrix || b.kind() == ValueKind::Matrix;
+        const bool toVector = !toMatrix && (a.kind() == ValueKind::Vector || b.kind() == ValueKind::Vector);
+        if (!toMatrix && !toVector) return scalarOp(op, a, b);
+
+        const size_t rows = std::max(x.rows, y.rows), cols = std::max(x.cols, y.cols);
+        const size_t total = rows * cols;
+        // Куски по строкам; результат из одной строки (вектор) делится по столбцам.
+        // body(i, jb, je) считает элементы [jb, je) строки i.
+        auto forBlocks = [&](const auto& body) {
+            if (rows == 1) {
+                par::parallelFor(cols, rowGrain(cols, 1), [&](size_t jb, size_t je) { body(0, jb, je); });
+                return;
+            }
+            par::parallelFor(rows, rowGrain(rows, cols), [&](size_t rb, size_t re) {
+                for (size_t i = rb; i < re; ++i) body(i, 0, cols);
+            });
+        };
+
+        if (x.ints && y.ints && op != ElemOp::Div) {
+            bool unchecked = false;
+            if (op == ElemOp::Mul) {
+                const uint64_t ma = intk::maxMagnitude(x.ints, x.rows * x.cols);
+                const uint64_t mb = intk::maxMagnitude(y.ints, y.rows * y.cols);
+                unchecked = intk::bitWidth(ma) + intk::bitWidth(mb) < 63;
+            }
+            std::vector<int64_t> out(total);
+            std::atomic<bool> overflow{ false };
+            forBlocks([&](size_t i, size_t jb, size_t je) {
+                if (overflow.load(std::memory_order_relaxed)) return;
+                if (!intRow(op, x.ints + i * x.rowStride() + jb * x.colStride(), x.colStride(),
+                    y.ints + i * y.rowStride() + jb * y.colStride(), y.colStride(),
+                    out.data() + i * cols + jb, je - jb, unchecked))
+                    overflow = true;
+            });
+            if (!overflow) {
+                if (toVector) return std::make_shared<VectorValue>(std::move(out));
+                return std::make_shared<MatrixValue>(rows, cols, std::move(out));
+            }
+        }
+
+        // Неточные данные (режим fast): поэлементно на complex<double> без упаковки
+        std::vector<cplx> bufX, bufY;
+        const cplx* px = x.packed || y.packed ? inexactData(a, bufX) : nullptr;
+        const cplx* py = px ? inexactData(b, bufY) : nullptr;
+        if (px && py) {
+            std::vector<cplx> out(total);
+            std::atomic<bool> divByZero{ false };
+            forBlocks([&](size_t i, size_t jb, size_t je) {
+                const cplx* ra = px + i * x.rowStride();
+                const cplx* rb = py + i * y.rowStride();
+                cplx* o = out.data() + i * cols;
+                const size_t sa = x.colStride(), sb = y.colStride();
+                for (size_t j = jb; j < je; ++j) {
+                    const cplx p = ra[j * sa], q = rb[j * sb];
+                    switch (op) {
+                    case ElemOp::Add: o[j] = p + q; break;
+                    case ElemOp::Sub: o[j] = p - q; break;
+                    case ElemOp::Mul: o[j] = p * q; break;
+                    default:
+                        if (std::abs(q.real()) < 1e-18 && std::abs(q.imag()) < 1e-18) divByZero = true;
+                        else o[j] = p / q;
+                    }
+                }
+            });
+            if (divByZero) throw EvalError("Деление на ноль.");
+            if (toVector) return std::make_shared<VectorValue>(std::move(out));
+            return std::make_shared<MatrixValue>(rows, cols, std::move(out));
+        }
+
+        x.box();
+        y.box();
+        std::vector<std::vector<ValuePtr>> out(rows, std::vector<ValuePtr>(cols));
+        forBlocks([&](size_t i, size_t jb, size_t je) {
+            for (size_t j = jb; j < je; ++j)
+                out[i][j] = scalarOp(op, x.at(i, j), y.at(i, j));
+        });
+        if (toVector) return std::make_shared<VectorValue>(std::move(out[0]));
+        return std::make_shared<MatrixValue>(std::move(out));
+    }
+
+    ValuePtr toInexact(const ValuePtr& v) {
+        const auto scalar = [](const Value& e) {
+            if (e.kind() == ValueKind::Complex) return static_cast<const ComplexValue&>(e).value();
+            auto& r = static_cast<const RationalValue&>(e);
+            return cplx(static_cast<double>(r.num()) / static_cast<double>(r.den()), 0.0);
+        };
+        std::vector<cplx> buf;
+        switch (v->kind()) {
+        case ValueKind::Rational:
+            return ComplexValue::create(scalar(*v).real(), 0.0);
+        case ValueKind::Vector: {
+            auto& x = static_cast<const VectorValue&>(*v);
+            if (x.isPacked()) return v;
+            if (!inexactData(x, buf))
+                for (auto& e : x.items()) buf.push_back(scalar(*e));
+            return std::make_shared<VectorValue>(std::move(buf));
+        }
+        case ValueKind::Matrix: {
+            auto& m = static_cast<const MatrixValue&>(*v);
+            if (m.isPacked()) return v;
+            if (!inexactData(m, buf))
+                for (auto& r : m.data())
+                    for (auto& e : r) buf.push_back(scalar(*e));
+            return std::make_shared<MatrixValue>(m.rows(), m.cols(), std::move(buf));
+        }
+        default:
+            return v;
+        }
+    }
+
+    // Скалярное произведение sum x(k) * y(k) упакованных элементов. Рациональные
+    // слагаемые копятся в RationalAccumulator (без RationalValue и НОД на каждом шаге);
+    // с первого комплексного элемента или переполнения — общий путь через Value.
+    template <class X, class Y>
+    static ValuePtr dotProduct(size_t n, const X& x, const Y& y) {
+        RationalAccumulator acc;
+        size_t k = 0;
+        for (; k < n; ++k) {
+            const Value& a = x(k);
+            const Value& b = y(k);
+            if (a.kind() != ValueKind::Rational || b.kind() != ValueKind::Rational) break;
+            auto& ra = static_cast<const RationalValue&>(a);
+            auto& rb = static_cast<const RationalValue&>(b);
+            if (!acc.addProduct(ra.num(), ra.den(), rb.num(), rb.den())) break;
+        }
+        ValuePtr sum = acc.result();
+        for (; k < n; ++k) sum = scalarAdd(*sum, *scalarMul(x(k), y(k)));
+        return sum;
+    }
+
+    // Все элементы комплексные — копирует их подряд в out. Смешанные с рациональными
+    // данные сюда не попадают: их точная часть считается общим путём.
+    static bool loadComplex(const std::vector<ValuePtr>& items, std::complex<double>* out) {
+        for (auto& x : items) {
+            if (x->kind() != ValueKind::Complex) return false;
+            *out++ = static_cast<const ComplexValue&>(*x).value();
+        }
+        return true;
+    }
+
+    static bool loadComplex(const MatrixValue& m, std::complex<double>* out) {
+        if (m.isInteger()) return false;
+        for (auto& r : m.data()) {
+            if (!loadComplex(r, out)) return false;
+            out += r.size();
+        }
+        return true;
+    }
+
+    static std::vector<ValuePtr> boxComplex(const std::complex<double>* p, size_t n) {
+        std::vector<ValuePtr> out(n);
+        for (size_t i = 0; i < n; ++i) out[i] = ComplexValue::create(p[i].real(), p[i].imag());
+        return out;
+    }
+
+    static ValuePtr complexMatrix(const std::complex<double>* p, size_t n) {
+        std::vector<std::vector<ValuePtr>> rows(n);
+        for (size_t i = 0; i < n; ++i) rows[i] = boxComplex(p + i * n, n);
+        return std::make_shared<MatrixValue>(std::move(rows));
+    }
+
+    // Произведения квадратных матриц 2..4 (и такой матрицы на вектор) развёрнутыми
+    // ядрами; nullptr — размер или представление не подходят, либо переполнение int64.
+    static ValuePtr mulSmall(const MatrixValue& a, const MatrixValue& b) {
+        ValuePtr res;
+        small::dispatch(a.rows(), [&](auto n) {
+            constexpr size_t N = decltype(n)::value;
+            if (a.isInteger() && b.isInteger()) {
+                small::CheckedInt ar;
+                std::vector<int64_t> out(N * N);
+                small::mul<N>(a.ints().data(), b.ints().data(), out.data(), ar);
+                if (ar.ok) res = std::make_shared<MatrixValue>(N, N, std::move(out));
+                return ar.ok;
+            }
+            small::Mat<std::complex<double>, N> x, y, out;
+            if (!loadComplex(a, x.data()) || !loadComplex(b, y.data())) return false;
+            small::Complex ar;
+            small::mul<N>(x.data(), y.data(), out.data(), ar);
+            res = complexMatrix(out.data(), N);
+            return true;
+        });
+        return res;
+    }
+
+    static ValuePtr matVecSmall(const MatrixValue& a, const VectorValue& v) {
+        ValuePtr res;
+        small::dispatch(a.rows(), [&](auto n) {
+            constexpr size_t N = decltype(n)::value;
+            if (a.isInteger() && v.isInteger()) {
+                small::CheckedInt ar;
+                std::vector<int64_t> out(N);
+                small::matVec<N>(a.ints().data(), v.ints().data(), out.data(), ar);
+                if (ar.ok) res = std::make_shared<VectorValue>(std::move(out));
+                return ar.ok;
+            }
+            small::Mat<std::complex<double>, N> x;
+            std::array<std::complex<double>, N> y, out;
+            if (v.isInteger() || !loadComplex(a, x.data()) || !loadComplex(v.items(), y.data())) return false;
+            small::Complex ar;
+            small::matVec<N>(x.data(), y.data(), out.data(), ar);
+            res = std::make_shared<VectorValue>(boxComplex(out.data(), N));
+            return true;
+        });
+        return res;
+    }
+
     VectorValue::VectorValue(std::vector<ValuePtr> items) : m_items(std::move(items)) {
         for (auto& x : m_items) {
             if (!x) throw EvalError("Вектор содержит пустой элемент.");
             ensureScalar(*x);
         }
+        m_size = m_items.size();
+        m_ints.reserve(m_size);
+        m_isInt = collectInts(m_items, m_ints);
+    }
+
+    VectorValue::VectorValue(std::vector<int64_t> ints)
+        : m_boxed(false), m_ints(std::move(ints)), m_isInt(true) {
+        m_size = m_ints.size();
+    }
+
+    VectorValue::VectorValue(std::vector<std::complex<double>> packed)
+        : m_boxed(false), m_packed(std::move(packed)), m_isPacked(true) {
+        m_size = m_packed.size();
+    }
+
+    const std::vector<ValuePtr>& VectorValue::items() const {
+        if (!m_boxed) {
+            std::call_once(m_boxOnce, [this] {
+                m_items.reserve(m_size);
+                for (int64_t n : m_ints) m_items.push_back(RationalValue::create(n));
+                for (auto& z : m_packed) m_items.push_back(ComplexValue::create(z.real(), z.imag()));
+                m_lazyBoxed.store(true, std::memory_order_release);
+            });
+        }
+        return m_items;
     }
 
     std::string VectorValue::toString() const {
+        if (m_isInt) return "[ " + intsRowToString(m_ints.data(), m_ints.size()) + " ]";
+
+        auto& x = items();
         std::ostringstream oss;
         oss << "[ ";
-        for (size_t i = 0; i < m_items.size(); ++i) {
+        for (size_t i = 0; i < x.size(); ++i) {
             if (i) oss << " ";
-            oss << m_items[i]->toString();
+            oss << x[i]->toString();
         }
         oss << " ]";
         return oss.str();
     }
 
     ValuePtr VectorValue::add(const Value& rhs) const {
-        if (rhs.kind() != ValueKind::Vector) return Value::add(rhs);
-        auto& v = static_cast<const VectorValue&>(rhs);
-        if (v.items().size() != m_items.size()) throw EvalError("Нельзя сложить векторы разных размеров.");
-        std::vector<ValuePtr> out;
-        out.reserve(m_items.size());
-        for (size_t i = 0; i < m_items.size(); ++i) out.push_back(scalarAdd(*m_items[i], *v.items()[i]));
-        return std::make_shared<VectorValue>(std::move(out));
+        // Вектор с вектором — только одинакового размера; скаляр и матрица расширяются.
+        if (rhs.kind() == ValueKind::Vector && static_cast<const VectorValue&>(rhs).size() != m_size)
+            throw EvalError("Нельзя сложить векторы разных размеров.");
+        return elementwise(ElemOp::Add, *this, rhs, "Нельзя сложить: несовместимые размеры.");
     }
 
     ValuePtr VectorValue::sub(const Value& rhs) const {
-        if (rhs.kind() != ValueKind::Vector) return Value::sub(rhs);
-        auto& v = static_cast<const VectorValue&>(rhs);
-        if (v.items().size() != m_items.size()) throw EvalError("Нельзя вычесть векторы разных размеров.");
-        std::vector<ValuePtr> out;
-        out.reserve(m_items.size());
-        for (size_t i = 0; i < m_items.size(); ++i) out.push_back(scalarSub(*m_items[i], *v.items()[i]));
-        return std::make_shared<VectorValue>(std::move(out));
+        if (rhs.kind() == ValueKind::Vector && static_cast<const VectorValue&>(rhs).size() != m_size)
+            throw EvalError("Нельзя вычесть векторы разных размеров.");
+        return elementwise(ElemOp::Sub, *this, rhs, "Нельзя вычесть: несовместимые размеры.");
     }
 
+    // Умножение и деление на скаляр — частный случай расширения скаляра.
     ValuePtr VectorValue::mul(const Value& rhs) const {
         if (!isScalar(rhs.kind())) return Value::mul(rhs);
-        std::vector<ValuePtr> out;
-        out.reserve(m_items.size());
-        for (auto& x : m_items) out.push_back(scalarMul(*x, rhs));
-        return std::make_shared<VectorValue>(std::move(out));
+        return elementwise(ElemOp::Mul, *this, rhs, "");
     }
 
     ValuePtr VectorValue::div(const Value& rhs) const {
         if (!isScalar(rhs.kind())) return Value::div(rhs);
-        std::vector<ValuePtr> out;
-        out.reserve(m_items.size());
-        for (auto& x : m_items) out.push_back(scalarDiv(*x, rhs));
+        return elementwise(ElemOp::Div, *this, rhs, "");
+    }
+
+    ValuePtr VectorValue::neg() const {
+        if (m_isInt) {
+            std::vector<int64_t> out(m_size);
+            if (negateInts(m_ints.data(), out.data(), m_size))
+                return std::make_shared<VectorValue>(std::move(out));
+        }
+        if (m_isPacked) {
+            std::vector<cplx> out(m_size);
+            par::parallelFor(m_size, rowGrain(m_size, 1), [&](size_t b, size_t e) {
+                for (size_t i = b; i < e; ++i) out[i] = cplx(0.0 - m_packed[i].real(), 0.0 - m_packed[i].imag());
+            });
+            return std::make_shared<VectorValue>(std::move(out));
+        }
+        auto& x = items();
+        std::vector<ValuePtr> out(m_size);
+        par::parallelFor(m_size, rowGrain(m_size, 1), [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) out[i] = x[i]->neg();
+        });
         return std::make_shared<VectorValue>(std::move(out));
     }
 
@@ -72,16 +533,64 @@ namespace mathcore {
                 ensureScalar(*x);
             }
         }
+        m_nRows = m_rows.size();
+        m_nCols = c;
+
+        m_ints.reserve(m_nRows * m_nCols);
+        m_isInt = true;
+        for (auto& r : m_rows) {
+            if (!collectInts(r, m_ints)) { m_isInt = false; break; }
+        }
+        if (!m_isInt) m_ints = {};
+    }
+
+    MatrixValue::MatrixValue(size_t rows, size_t cols, std::vector<int64_t> ints)
+        : m_boxed(false), m_ints(std::move(ints)), m_isInt(true), m_nRows(rows), m_nCols(cols) {
+        if (rows == 0) throw EvalError("Матрица не может быть пустой.");
+        if (cols == 0) throw EvalError("Матрица не может иметь 0 столбцов.");
+        if (m_ints.size() != rows * cols) throw EvalError("Все строки матрицы должны иметь одинаковую длину.");
+    }
+
+    MatrixValue::MatrixValue(size_t rows, size_t cols, std::vector<std::complex<double>> packed)
+        : m_boxed(false), m_packed(std::move(packed)), m_isPacked(true), m_nRows(rows), m_nCols(cols) {
+        if (rows == 0) throw EvalError("Матрица не может быть пустой.");
+        if (cols == 0) throw EvalError("Матрица не может иметь 0 столбцов.");
+        if (m_packed.size() != rows * cols) throw EvalError("Все строки матрицы должны иметь одинаковую длину.");
+    }
+
+    const std::vector<std::vector<ValuePtr>>& MatrixValue::data() const {
+        if (!m_boxed) {
+            std::call_once(m_boxOnce, [this] {
+                m_rows.assign(m_nRows, std::vector<ValuePtr>(m_nCols));
+                for (size_t i = 0; i < m_nRows; ++i)
+                    for (size_t j = 0; j < m_nCols; ++j) {
+                        const size_t k = i * m_nCols + j;
+                        m_rows[i][j] = m_isPacked ? ComplexValue::create(m_packed[k].real(), m_packed[k].imag())
+                            : RationalValue::create(m_ints[k]);
+                    }
+                m_lazyBoxed.store(true, std::memory_order_release);
+            });
+        }
+        return m_rows;
     }
 
     std::string MatrixValue::toString() const {
         std::ostringstream oss;
         oss << "[\n";
-        for (size_t i = 0; i < m_rows.size(); ++i) {
+        if (m_isInt) {
+            for (size_t i = 0; i < m_nRows; ++i) {
+                if (i) oss << ";\n";
+                oss << intsRowToString(m_ints.data() + i * m_nCols, m_nCols);
+            }
+            oss << "\n]";
+            return oss.str();
+        }
+        auto& a = data();
+        for (size_t i = 0; i < a.size(); ++i) {
             if (i) oss << ";\n";
-            for (size_t j = 0; j < m_rows[i].size(); ++j) {
+            for (size_t j = 0; j < a[i].size(); ++j) {
                 if (j) oss << " ";
-                oss << m_rows[i][j]->toString();
+                oss << a[i][j]->toString();
             }
         }
         oss << "\n]";
@@ -89,51 +598,50 @@ namespace mathcore {
     }
 
     ValuePtr MatrixValue::add(const Value& rhs) const {
-        if (rhs.kind() != ValueKind::Matrix) return Value::add(rhs);
-        auto& m = static_cast<const MatrixValue&>(rhs);
-        if (rows() != m.rows() || cols() != m.cols()) throw EvalError("Нельзя сложить матрицы разных размеров.");
-        std::vector<std::vector<ValuePtr>> out(rows(), std::vector<ValuePtr>(cols()));
-        for (size_t i = 0; i < rows(); ++i)
-            for (size_t j = 0; j < cols(); ++j)
-                out[i][j] = scalarAdd(*m_rows[i][j], *m.data()[i][j]);
-        return std::make_shared<MatrixValue>(std::move(out));
+        return elementwise(ElemOp::Add, *this, rhs, "Нельзя сложить матрицы разных размеров.");
     }
 
     ValuePtr MatrixValue::sub(const Value& rhs) const {
-        if (rhs.kind() != ValueKind::Matrix) return Value::sub(rhs);
-        auto& m = static_cast<const MatrixValue&>(rhs);
-        if (rows() != m.rows() || cols() != m.cols()) throw EvalError("Нельзя вычесть матрицы разных размеров.");
-        std::vector<std::vector<ValuePtr>> out(rows(), std::vector<ValuePtr>(cols()));
-        for (size_t i = 0; i < rows(); ++i)
-            for (size_t j = 0; j < cols(); ++j)
-                out[i][j] = scalarSub(*m_rows[i][j], *m.data()[i][j]);
-        return std::make_shared<MatrixValue>(std::move(out));
+        return elementwise(ElemOp::Sub, *this, rhs, "Нельзя вычесть матрицы разных размеров.");
     }
 
     ValuePtr MatrixValue::mul(const Value& rhs) const {
         // Matrix * Scalar
-        if (isScalar(rhs.kind())) {
-            std::vector<std::vector<ValuePtr>> out(rows(), std::vector<ValuePtr>(cols()));
-            for (size_t i = 0; i < rows(); ++i)
-                for (size_t j = 0; j < cols(); ++j)
-                    out[i][j] = scalarMul(*m_rows[i][j], rhs);
-            return std::make_shared<MatrixValue>(std::move(out));
-        }
+        if (isScalar(rhs.kind())) return elementwise(ElemOp::Mul, *this, rhs, "");
 
         // Matrix * Vector
         if (rhs.kind() == ValueKind::Vector) {
             auto& v = static_cast<const VectorValue&>(rhs);
-            if (cols() != v.items().size()) throw EvalError("Нельзя умножить: число столбцов матрицы не равно размеру вектора.");
-            std::vector<ValuePtr> out(rows());
-            for (size_t i = 0; i < rows(); ++i) {
-                // sum_j a[i][j] * v[j]
-                ValuePtr acc = RationalValue::create(0);
-                for (size_t j = 0; j < cols(); ++j) {
-                    auto prod = scalarMul(*m_rows[i][j], *v.items()[j]);
-                    acc = scalarAdd(*acc, *prod);
+            if (cols() != v.size()) throw EvalError("Нельзя умножить: число столбцов матрицы не равно размеру вектора.");
+            const size_t grain = rowGrain(rows(), cols());
+            if (m_isPacked || v.isPacked()) {
+                std::vector<cplx> ta, tb;
+                const cplx* pa = inexactData(*this, ta);
+                const cplx* pb = pa ? inexactData(v, tb) : nullptr;
+                if (pb) {
+                    std::vector<cplx> out(rows());
+                    matMulPacked(pa, pb, out.data(), rows(), cols(), 1, grain);
+                    return std::make_shared<VectorValue>(std::move(out));
                 }
-                out[i] = acc;
             }
+            if (rows() == cols())
+                if (auto r = matVecSmall(*this, v)) return r;
+            if (m_isInt && v.isInteger()) {
+                std::vector<int64_t> out(rows());
+                if (matMulRows(m_ints.data(), v.ints().data(), out.data(), rows(), cols(), 1, grain))
+                    return std::make_shared<VectorValue>(std::move(out));
+            }
+            auto& a = data();
+            auto& x = v.items();
+            std::vector<ValuePtr> out(rows());
+            par::parallelFor(rows(), grain, [&](size_t rb, size_t re) {
+                for (size_t i = rb; i < re; ++i) {
+                    // sum_j a[i][j] * v[j]
+                    auto& row = a[i];
+                    out[i] = dotProduct(cols(), [&](size_t j) -> const Value& { return *row[j]; },
+                        [&](size_t j) -> const Value& { return *x[j]; });
+                }
+            });
             return std::make_shared<VectorValue>(std::move(out));
         }
 
@@ -141,17 +649,36 @@ namespace mathcore {
         if (rhs.kind() == ValueKind::Matrix) {
             auto& b = static_cast<const MatrixValue&>(rhs);
             if (cols() != b.rows()) throw EvalError("Нельзя умножить матрицы: A.cols != B.rows.");
+            const size_t grain = rowGrain(rows(), cols() * b.cols());
+            if (m_isPacked || b.isPacked()) {
+                std::vector<cplx> ta, tb;
+                const cplx* pa = inexactData(*this, ta);
+                const cplx* pb = pa ? inexactData(b, tb) : nullptr;
+                if (pb) {
+                    std::vector<cplx> out(rows() * b.cols());
+                    matMulPacked(pa, pb, out.data(), rows(), cols(), b.cols(), grain);
+                    return std::make_shared<MatrixValue>(rows(), b.cols(), std::move(out));
+                }
+            }
+            if (rows() == cols() && b.rows() == b.cols())
+                if (auto r = mulSmall(*this, b)) return r;
+            if (m_isInt && b.isInteger()) {
+                std::vector<int64_t> out(rows() * b.cols());
+                if (matMulRows(m_ints.data(), b.ints().data(), out.data(), rows(), cols(), b.cols(), grain))
+                    return std::make_shared<MatrixValue>(rows(), b.cols(), std::move(out));
+            }
+            auto& a = data();
+            auto& bd = b.data();
             std::vector<std::vector<ValuePtr>> out(rows(), std::vector<ValuePtr>(b.cols()));
-            for (size_t i = 0; i < rows(); ++i) {
-                for (size_t k = 0; k < b.cols(); ++k) {
-                    ValuePtr acc = RationalValue::create(0);
-                    for (size_t j = 0; j < cols(); ++j) {
-                        auto prod = scalarMul(*m_rows[i][j], *b.data()[j][k]);
-                        acc = scalarAdd(*acc, *prod);
+            par::parallelFor(rows(), grain, [&](size_t rb, size_t re) {
+                for (size_t i = rb; i < re; ++i) {
+                    auto& row = a[i];
+                    for (size_t k = 0; k < b.cols(); ++k) {
+                        out[i][k] = dotProduct(cols(), [&](size_t j) -> const Value& { return *row[j]; },
+                            [&](size_t j) -> const Value& { return *bd[j][k]; });
                     }
-                    out[i][k] = acc;
                 }
-            }
+            });
             return std::make_shared<MatrixValue>(std::move(out));
         }
 
@@ -160,19 +687,426 @@ namespace mathcore {
 
     ValuePtr MatrixValue::div(const Value& rhs) const {
         if (!isScalar(rhs.kind())) return Value::div(rhs);
+        return elementwise(ElemOp::Div, *this, rhs, "");
+    }
+
+    ValuePtr MatrixValue::neg() const {
+        if (m_isInt) {
+            std::vector<int64_t> out(m_ints.size());
+            if (negateInts(m_ints.data(), out.data(), out.size()))
+                return std::make_shared<MatrixValue>(rows(), cols(), std::move(out));
+        }
+        if (m_isPacked) {
+            std::vector<cplx> out(m_packed.size());
+            par::parallelFor(out.size(), rowGrain(out.size(), 1), [&](size_t b, size_t e) {
+                for (size_t i = b; i < e; ++i) out[i] = cplx(0.0 - m_packed[i].real(), 0.0 - m_packed[i].imag());
+            });
+            return std::make_shared<MatrixValue>(rows(), cols(), std::move(out));
+        }
+        auto& a = data();
         std::vector<std::vector<ValuePtr>> out(rows(), std::vector<ValuePtr>(cols()));
-        for (size_t i = 0; i < rows(); ++i)
-            for (size_t j = 0; j < cols(); ++j)
-                out[i][j] = scalarDiv(*m_rows[i][j], rhs);
+        par::parallelFor(rows(), rowGrain(rows(), cols()), [&](size_t rb, size_t re) {
+            for (size_t i = rb; i < re; ++i)
+                for (size_t j = 0; j < cols(); ++j)
+                    out[i][j] = a[i][j]->neg();
+        });
         return std::make_shared<MatrixValue>(std::move(out));
     }
 
+    ValuePtr MatrixValue::pow(const Value& rhs) const {
+        if (rhs.kind() != ValueKind::Rational && rhs.kind() != ValueKind::Complex) return Value::pow(rhs);
+        // Показатель в режиме fast неточный: комплексное число с целой вещественной частью
+        // и нулевой мнимой тоже подходит.
+        int64_t power = -1;
+        if (rhs.kind() == ValueKind::Rational) {
+            auto& e = static_cast<const RationalValue&>(rhs);
+            if (e.den() == 1) power = e.num();
+        }
+        else {
+            const auto z = static_cast<const ComplexValue&>(rhs).value();
+            if (z.imag() == 0.0 && z.real() >= 0.0 && z.real() < 9.2e18 && std::floor(z.real()) == z.real())
+                power = static_cast<int64_t>(z.real());
+        }
+        if (power < 0) throw EvalError("Матрицу можно возводить только в целую неотрицательную степень.");
+        if (rows() != cols()) throw EvalError("Возводить в степень можно только квадратную матрицу.");
+
+        // Бинарное возведение: O(log k) произведений вместо k-1.
+        uint64_t k = static_cast<uint64_t>(power);
+        if (k == 0) {
+            std::vector<int64_t> id(rows() * cols(), 0);
+            for (size_t i = 0; i < rows(); ++i) id[i * cols() + i] = 1;
+            return std::make_shared<MatrixValue>(rows(), cols(), std::move(id));
+        }
+
+        const Value* base = this;
+        ValuePtr baseHold, result;
+        for (; k; k >>= 1) {
+            if (k & 1) {
+                if (result) result = result->mul(*base);
+                else if (baseHold) result = baseHold;
+                // Первый множитель — исходная матрица: нужна копия (shared_ptr на this нет)
+                else if (m_isInt) result = std::make_shared<MatrixValue>(rows(), cols(), m_ints);
+                else if (m_isPacked) result = std::make_shared<MatrixValue>(rows(), cols(), m_packed);
+                else result = std::make_shared<MatrixValue>(data());
+            }
+            if (k > 1) {
+                baseHold = base->mul(*base);
+                base = baseHold.get();
+            }
+        }
+        return result;
+    }
+
     ValuePtr MatrixValue::transpose() const {
-        std::vector<std::vector<ValuePtr>> out(cols(), std::vector<ValuePtr>(rows()));
-        for (size_t i = 0; i < rows(); ++i)
-            for (size_t j = 0; j < cols(); ++j)
-                out[j][i] = m_rows[i][j];
-        return std::make_shared<MatrixValue>(std::move(out));
+        // Обратная ссылка из транспонированной матрицы не ставится — иначе цикл shared_ptr.
+        std::call_once(m_tOnce, [this] {
+            if (m_isInt) {
+                std::vector<int64_t> out(m_ints.size());
+                const bool done = rows() == cols() && small::dispatch(rows(), [&](auto n) {
+                    small::transpose<decltype(n)::value>(m_ints.data(), out.data());
+                    return true;
+                });
+                if (!done) transposeRows(m_ints.data(), out.data(), rows(), cols());
+                m_transposed = std::make_shared<MatrixValue>(cols(), rows(), std::move(out));
+                m_tReady.store(true, std::memory_order_release);
+                return;
+            }
+            if (m_isPacked) {
+                std::vector<cplx> out(m_packed.size());
+                transposeRows(m_packed.data(), out.data(), rows(), cols());
+                m_transposed = std::make_shared<MatrixValue>(cols(), rows(), std::move(out));
+                m_tReady.store(true, std::memory_order_release);
+                return;
+            }
+            std::vector<std::vector<ValuePtr>> out(cols(), std::vector<ValuePtr>(rows()));
+            par::parallelFor(cols(), rowGrain(cols(), rows()), [&](size_t jb, size_t je) {
+                for (size_t j = jb; j < je; ++j)
+                    for (size_t i = 0; i < rows(); ++i)
+                        out[j][i] = m_rows[i][j];
+            });
+            m_transposed = std::make_shared<MatrixValue>(std::move(out));
+            m_tReady.store(true, std::memory_order_release);
+        });
+        return m_transposed;
+    }
+
+    namespace {
+
+        bool isZero(const Value& v) {
+            if (v.kind() == ValueKind::Rational) return static_cast<const RationalValue&>(v).num() == 0;
+            return static_cast<const ComplexValue&>(v).value() == std::complex<double>(0.0, 0.0);
+        }
+
+        // Модуль для выбора ведущего элемента (точность здесь не важна).
+        double magnitudeOf(const Value& v) {
+            if (v.kind() == ValueKind::Rational) {
+                auto& r = static_cast<const RationalValue&>(v);
+                return std::fabs(static_cast<double>(r.num()) / static_cast<double>(r.den()));
+            }
+            return std::abs(static_cast<const ComplexValue&>(v).value());
+        }
+
+        bool equalScalars(const Value& a, const Value& b) {
+            if (a.kind() != b.kind()) return false;
+            if (a.kind() == ValueKind::Rational) {
+                auto& x = static_cast<const RationalValue&>(a);
+                auto& y = static_cast<const RationalValue&>(b);
+                return x.num() == y.num() && x.den() == y.den();
+            }
+            return static_cast<const ComplexValue&>(a).value() == static_cast<const ComplexValue&>(b).value();
+        }
+
+        // Определитель целой квадратной матрицы методом Барейсса: все промежуточные
+        // значения — целые (деление точное). false при переполнении int64.
+        bool bareissDet(std::vector<int64_t> a, size_t n, int64_t& det) {
+            int64_t prev = 1;
+            bool negative = false;
+            for (size_t k = 0; k + 1 < n; ++k) {
+                cancel::check();
+                if (a[k * n + k] == 0) {
+                    size_t p = k + 1;
+                    while (p < n && a[p * n + k] == 0) ++p;
+                    if (p == n) { det = 0; return true; }
+                    for (size_t j = 0; j < n; ++j) std::swap(a[k * n + j], a[p * n + j]);
+                    negative = !negative;
+                }
+                const int64_t pivot = a[k * n + k];
+                for (size_t i = k + 1; i < n; ++i) {
+                    for (size_t j = k + 1; j < n; ++j) {
+                        int64_t x, y;
+                        if (!intk::mulChecked(a[i * n + j], pivot, x)) return false;
+                        if (!intk::mulChecked(a[i * n + k], a[k * n + j], y)) return false;
+                        if (!intk::subChecked(x, y, x)) return false;
+                        a[i * n + j] = x / prev;
+                    }
+                }
+                prev = pivot;
+            }
+            det = a[n * n - 1];
+            if (negative) {
+                if (det == INT64_MIN) return false;
+                det = -det;
+            }
+            return true;
+        }
+
+    } // namespace
+
+    // Определитель квадратной матрицы 2..4 по явной формуле (целые или комплексные элементы).
+    static ValuePtr smallDet(const MatrixValue& m) {
+        ValuePtr res;
+        small::dispatch(m.rows(), [&](auto n) {
+            constexpr size_t N = decltype(n)::value;
+            if (m.isInteger()) {
+                small::CheckedInt ar;
+                const int64_t d = small::det<N>(m.ints().data(), ar);
+                if (ar.ok) res = RationalValue::create(d);
+                return ar.ok;
+            }
+            small::Mat<std::complex<double>, N> x;
+            if (!loadComplex(m, x.data())) return false;
+            small::Complex ar;
+            const auto d = small::det<N>(x.data(), ar);
+            res = ComplexValue::create(d.real(), d.imag());
+            return true;
+        });
+        return res;
+    }
+
+    ValuePtr small::inverse(const MatrixValue& m) {
+        if (m.rows() != m.cols()) return nullptr;
+        ValuePtr res;
+        small::dispatch(m.rows(), [&](auto n) {
+            constexpr size_t N = decltype(n)::value;
+            if (m.isInteger()) {
+                small::CheckedInt ar;
+                small::Mat<int64_t, N> adj;
+                const int64_t d = small::det<N>(m.ints().data(), ar);
+                small::adjugate<N>(m.ints().data(), adj.data(), ar);
+                if (!ar.ok) return false;
+                if (d == 0) throw EvalError("Матрица вырождена.");
+                std::vector<std::vector<ValuePtr>> rows(N, std::vector<ValuePtr>(N));
+                for (size_t i = 0; i < N; ++i)
+                    for (size_t j = 0; j < N; ++j) rows[i][j] = RationalValue::create(adj[i * N + j], d);
+                res = std::make_shared<MatrixValue>(std::move(rows));
+                return true;
+            }
+            small::Mat<std::complex<double>, N> x, adj;
+            if (!loadComplex(m, x.data())) return false;
+            small::Complex ar;
+            const auto d = small::det<N>(x.data(), ar);
+            if (d == std::complex<double>(0.0, 0.0)) throw EvalError("Матрица вырождена.");
+            small::adjugate<N>(x.data(), adj.data(), ar);
+            for (auto& v : adj) v /= d;
+            res = complexMatrix(adj.data(), N);
+            return true;
+        });
+        return res;
+    }
+
+    const LUFactors& MatrixValue::lu() const {
+        std::call_once(m_luOnce, [this] {
+            auto f = std::make_unique<LUFactors>();
+            f->lu = data();
+            auto& a = f->lu;
+            const size_t m = rows(), n = cols();
+            f->perm.resize(m);
+            for (size_t i = 0; i < m; ++i) f->perm[i] = i;
+
+            for (size_t col = 0, row = 0; col < n && row < m; ++col) {
+                cancel::check(); // разложение большой матрицы — самая долгая операция без пула
+                // Ведущий — наибольший по модулю ненулевой элемент столбца.
+                size_t p = m;
+                double best = 0.0;
+                for (size_t i = row; i < m; ++i) {
+                    if (isZero(*a[i][col])) continue;
+                    const double mag = magnitudeOf(*a[i][col]);
+                    if (p == m || mag > best) { p = i; best = mag; }
+                }
+                if (p == m) continue;
+                if (p != row) {
+                    std::swap(a[p], a[row]);
+                    std::swap(f->perm[p], f->perm[row]);
+                    f->oddPermutation = !f->oddPermutation;
+                }
+                f->pivotCols.push_back(col);
+
+                for (size_t i = row + 1; i < m; ++i) {
+                    if (isZero(*a[i][col])) continue;
+                    auto factor = scalarDiv(*a[i][col], *a[row][col]);
+                    for (size_t j = col + 1; j < n; ++j)
+                        a[i][j] = scalarSub(*a[i][j], *scalarMul(*factor, *a[row][j]));
+                    a[i][col] = std::move(factor);
+                }
+                ++row;
+            }
+            m_lu = std::move(f);
+            m_luReady.store(true, std::memory_order_release);
+        });
+        return *m_lu;
+    }
+
+    ValuePtr MatrixValue::det() const {
+        if (rows() != cols()) throw EvalError("Определитель есть только у квадратной матрицы.");
+        std::call_once(m_detOnce, [this] {
+            m_det = [this]() -> ValuePtr {
+                const size_t n = rows();
+                ValuePtr small = smallDet(*this);
+                if (small) return small;
+                int64_t d;
+                if (m_isInt && bareissDet(m_ints, n, d)) return RationalValue::create(d);
+                if (isDiagonal()) {
+                    auto& a = data();
+                    ValuePtr acc = a[0][0];
+                    for (size_t i = 1; i < n; ++i) acc = scalarMul(*acc, *a[i][i]);
+                    return acc;
+                }
+
+                auto& f = lu();
+                if (f.pivotCols.size() < n) return RationalValue::create(0);
+                ValuePtr acc = RationalValue::create(f.oddPermutation ? -1 : 1);
+                for (size_t i = 0; i < n; ++i) acc = scalarMul(*acc, *f.lu[i][i]);
+                return acc;
+            }();
+            m_detReady.store(true, std::memory_order_release);
+        });
+        return m_det;
+    }
+
+    void MatrixValue::classify() const {
+        std::call_once(m_classOnce, [this] {
+            const size_t n = rows();
+            bool diag = n == cols(), sym = n == cols();
+            if (m_isInt) {
+                for (size_t i = 0; i < n && (diag || sym); ++i)
+                    for (size_t j = 0; j < cols(); ++j) {
+                        const int64_t x = m_ints[i * cols() + j];
+                        if (i != j && x != 0) diag = false;
+                        if (sym && j < n && x != m_ints[j * cols() + i]) sym = false;
+                    }
+            }
+            else {
+                auto& a = data();
+                for (size_t i = 0; i < n && (diag || sym); ++i)
+                    for (size_t j = 0; j < cols(); ++j) {
+                        if (i != j && !isZero(*a[i][j])) diag = false;
+                        if (sym && j < n && !equalScalars(*a[i][j], *a[j][i])) sym = false;
+                    }
+            }
+            m_diagonal = diag;
+            m_symmetric = sym;
+        });
+    }
+
+    bool MatrixValue::isDiagonal() const {
+        classify();
+        return m_diagonal;
+    }
+
+    bool MatrixValue::isSymmetric() const {
+        classify();
+        return m_symmetric;
+    }
+
+    // Целые и упакованные данные хешируются по-разному: это безопасно, потому что
+    // конструкторы всегда распознают целые элементы, и равные значения хранятся одинаково.
+    static size_t hashInts(size_t seed, const std::vector<int64_t>& ints) {
+        for (int64_t x : ints) seed = Value::mixHash(seed, static_cast<uint64_t>(x));
+        return seed;
+    }
+
+    size_t VectorValue::computeHash() const {
+        size_t h = mixHash(static_cast<size_t>(ValueKind::Vector), m_size);
+        if (m_isInt) return hashInts(h, m_ints);
+        // Неточные элементы хешируются через ComplexValue — так же, как равный вектор из Value
+        for (auto& x : items()) h = mixHash(h, x->hash());
+        return h;
+    }
+
+    bool VectorValue::sameContent(const Value& other) const {
+        auto& v = static_cast<const VectorValue&>(other);
+        if (m_size != v.m_size || m_isInt != v.m_isInt) return false;
+        if (m_isInt) return m_ints == v.m_ints;
+        if (m_isPacked && v.m_isPacked) return m_packed == v.m_packed;
+        auto& x = items();
+        auto& y = v.items();
+        for (size_t i = 0; i < m_size; ++i)
+            if (!x[i]->equals(*y[i])) return false;
+        return true;
+    }
+
+    size_t MatrixValue::computeHash() const {
+        size_t h = mixHash(mixHash(static_cast<size_t>(ValueKind::Matrix), m_nRows), m_nCols);
+        if (m_isInt) return hashInts(h, m_ints);
+        for (auto& r : data())
+            for (auto& x : r) h = mixHash(h, x->hash());
+        return h;
+    }
+
+    bool MatrixValue::sameContent(const Value& other) const {
+        auto& m = static_cast<const MatrixValue&>(other);
+        if (m_nRows != m.m_nRows || m_nCols != m.m_nCols || m_isInt != m.m_isInt) return false;
+        if (m_isInt) return m_ints == m.m_ints;
+        if (m_isPacked && m.m_isPacked) return m_packed == m.m_packed;
+        auto& a = data();
+        auto& b = m.data();
+        for (size_t i = 0; i < m_nRows; ++i)
+            for (size_t j = 0; j < m_nCols; ++j)
+                if (!a[i][j]->equals(*b[i][j])) return false;
+        return true;
+    }
+
+    static size_t boxedBytes(const std::vector<ValuePtr>& items) {
+        size_t bytes = items.capacity() * sizeof(ValuePtr);
+        for (auto& x : items) bytes += x->footprint();
+        return bytes;
+    }
+
+    // Упакованный элемент: указатель плюс скаляр с блоком управления.
+    static constexpr size_t kBoxedElement = sizeof(ValuePtr) + Value::kSharedControlBlock +
+        (sizeof(RationalValue) > sizeof(ComplexValue) ? sizeof(RationalValue) : sizeof(ComplexValue));
+
+    size_t VectorValue::footprint() const {
+        size_t bytes = sizeof(VectorValue) + kSharedControlBlock + m_ints.capacity() * sizeof(int64_t) +
+            m_packed.capacity() * sizeof(std::complex<double>);
+        if (m_boxed || m_lazyBoxed.load(std::memory_order_acquire)) bytes += boxedBytes(m_items);
+        return bytes;
+    }
+
+    size_t VectorValue::estimateFootprint(size_t n, bool integer) {
+        // Неполностью целый результат хранит и упакованные элементы, и, возможно, int64.
+        return sizeof(VectorValue) + kSharedControlBlock + n * (sizeof(int64_t) + (integer ? 0 : kBoxedElement));
+    }
+
+    size_t VectorValue::estimatePackedFootprint(size_t n) {
+        return sizeof(VectorValue) + kSharedControlBlock + n * sizeof(std::complex<double>);
+    }
+
+    size_t MatrixValue::footprint() const {
+        size_t bytes = sizeof(MatrixValue) + kSharedControlBlock + m_ints.capacity() * sizeof(int64_t) +
+            m_packed.capacity() * sizeof(std::complex<double>);
+        if (m_boxed || m_lazyBoxed.load(std::memory_order_acquire)) {
+            bytes += m_rows.capacity() * sizeof(m_rows[0]);
+            for (auto& r : m_rows) bytes += boxedBytes(r);
+        }
+        if (m_luReady.load(std::memory_order_acquire)) {
+            bytes += sizeof(LUFactors) + m_lu->lu.capacity() * sizeof(m_lu->lu[0]) +
+                (m_lu->perm.capacity() + m_lu->pivotCols.capacity()) * sizeof(size_t);
+            for (auto& r : m_lu->lu) bytes += boxedBytes(r);
+        }
+        if (m_detReady.load(std::memory_order_acquire)) bytes += m_det->footprint();
+        if (m_tReady.load(std::memory_order_acquire)) bytes += m_transposed->footprint();
+        return bytes;
+    }
+
+    size_t MatrixValue::estimateFootprint(size_t rows, size_t cols, bool integer) {
+        size_t bytes = sizeof(MatrixValue) + kSharedControlBlock + rows * cols * sizeof(int64_t);
+        if (!integer) bytes += rows * sizeof(std::vector<ValuePtr>) + rows * cols * kBoxedElement;
+        return bytes;
+    }
+
+    size_t MatrixValue::estimatePackedFootprint(size_t rows, size_t cols) {
+        return sizeof(MatrixValue) + kSharedControlBlock + rows * cols * sizeof(std::complex<double>);
     }
 
 } // namespace mathcore
@@ -1,10 +1,17 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 
+#include "MathCore/DiskMatrix.h"
 #include "MathCore/Interpreter.h"
+#include "MathCore/Operations.h"
+#include "MathCore/Optimizer.h"
 #include "MathCore/RationalValue.h"
 #include "MathCore/VectorMatrix.h"
 
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace MathTests {
@@ -22,6 +29,26 @@ public:
         auto c = a->add(*b);
         Assert::AreEqual(std::string("1/2"), c->toString());
     }
+
+    TEST_METHOD(NormalizationWithPowersOfTwo) {
+        Assert::AreEqual(std::string("-3/5"), mathcore::RationalValue::create(96, -160)->toString());
+        Assert::AreEqual(std::string("0"), mathcore::RationalValue::create(0, 7)->toString());
+        Assert::IsTrue(mathcore::RationalValue::create(0, 7)->equals(*mathcore::RationalValue::create(0)));
+    }
+
+    TEST_METHOD(NegationOfInt64MinOverflows) {
+        auto min = mathcore::RationalValue::create(INT64_MIN);
+        Assert::ExpectException<mathcore::EvalError>([&] { min->neg(); });
+        Assert::AreEqual(std::string("-9223372036854775807"), mathcore::RationalValue::create(INT64_MAX)->neg()->toString());
+    }
+
+    TEST_METHOD(RationalMatrixProductIsExact) {
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 1/2 1/3; 1/4 1/5 ]");
+        Assert::AreEqual(std::string("[ 2+(1/6) 1+(3/20) ]"), (*it.executeLine("A * [ 3 2 ]"))->toString());
+        Assert::AreEqual(std::string("[\n1/3 7/30;\n7/40 37/300\n]"), (*it.executeLine("A * A"))->toString());
+        Assert::AreEqual(std::string("[ 0.5000000000+0.3333333333i 0.2500000000+0.2000000000i ]"), (*it.executeLine("A * [ 1 i ]"))->toString());
+    }
     };
 
     TEST_CLASS(InterpreterSmokeTests) {
@@ -46,4 +73,737 @@ public:
     }
     };
 
+    TEST_CLASS(IntegerFastPathTests) {
+public:
+    TEST_METHOD(IntegerMatrixProduct) {
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 1 2; 3 4 ]");
+        it.executeLine("B = [ 5 6; 7 8 ]");
+        auto c = it.executeLine("A * B");
+        Assert::AreEqual(std::string("[\n19 22;\n43 50\n]"), (*c)->toString());
+
+        auto v = it.executeLine("A * [ 1 1 ]");
+        Assert::AreEqual(std::string("[ 3 7 ]"), (*v)->toString());
+    }
+
+    TEST_METHOD(MixedWithRationalFallsBack) {
+        mathcore::Interpreter it;
+        auto v = it.executeLine("[ 1 2 ] + [ 1/2 1 ]");
+        Assert::AreEqual(std::string("[ 1+(1/2) 3 ]"), (*v)->toString());
+    }
+
+    TEST_METHOD(CheckedKernelNearInt64Limit) {
+        // Оценка по модулям не проходит, но точное произведение помещается в int64.
+        mathcore::Interpreter it;
+        auto m = it.executeLine("[ 3037000499; 0 ] * T([ 3037000499; 1 ])");
+        Assert::AreEqual(std::string("[\n9223372030926249001 3037000499;\n0 0\n]"), (*m)->toString());
+    }
+
+    TEST_METHOD(NumericLiteralMatchesExpressionElements) {
+        // Литерал из одних чисел собирает токенизатор; скобки вокруг элементов — обычный разбор
+        mathcore::Interpreter it;
+        auto fast = it.executeLine("[ 1 2.5 .5 3.; 10 0.25 7 1 ; ]");
+        auto slow = it.executeLine("[ (1) (2.5) (.5) (3.); (10) (0.25) (7) (1) ; ]");
+        Assert::AreEqual((*slow)->toString(), (*fast)->toString());
+        auto ints = it.executeLine("[ 4 5 6 ]");
+        Assert::IsTrue(static_cast<const mathcore::VectorValue&>(**ints).isInteger());
+
+        // Минус: в начале строки — знак элемента, после элемента — вычитание из него
+        mathcore::Tokenizer tz("[ -1 2 -3 4; - -5 6.5 - 1 7 ]");
+        Assert::IsTrue(tz.peek().type == mathcore::TokType::Literal && tz.peek(1).type == mathcore::TokType::End);
+        Assert::AreEqual(std::string("[\n-1 -1 4;\n5 5+(1/2) 7\n]"), (*it.executeLine("[ -1 2 -3 4; - -5 6.5 - 1 7 ]"))->toString());
+        Assert::AreEqual((*it.executeLine("[ (1) - (2) (3); (-4) (5) ]"))->toString(),
+            (*it.executeLine("[ 1 -2 3; -4 5 ]"))->toString());
+        Assert::AreEqual(std::string("[ -1 3 ]"), (*it.executeLine("[1 -2 3]"))->toString());
+        Assert::IsTrue(static_cast<const mathcore::VectorValue&>(**it.executeLine("[ -7 8-1 ]")).isInteger());
+
+        auto ragged = it.tryExecuteLine("[ 1 2; 3 ]");
+        Assert::IsFalse(ragged.ok());
+        auto tooLong = mathcore::Parser::parseLine("X = [ 1 99999999999999999999 ]");
+        Assert::IsTrue(tooLong.error && tooLong.error->code == mathcore::ErrorCode::InvalidNumber);
+        Assert::AreEqual(9, tooLong.error->col);
+    }
+    };
+
+    TEST_CLASS(SharedBaseContextTests) {
+public:
+    TEST_METHOD(SessionsSeeBaseAndShadowIt) {
+        mathcore::Interpreter loader;
+        loader.executeLine("B = [ 1 2 ]");
+        auto base = std::make_shared<const mathcore::Context>(loader.ctx());
+
+        mathcore::Interpreter s1(base), s2(base);
+        s1.executeLine("B = 7");
+        Assert::AreEqual(std::string("7"), (*s1.executeLine("B"))->toString());
+        Assert::AreEqual(std::string("[ 2 4 ]"), (*s2.executeLine("B * 2"))->toString());
+    }
+    };
+
+    TEST_CLASS(CancellationTests) {
+public:
+    TEST_METHOD(CancelledLineKeepsContext) {
+        mathcore::Interpreter it;
+        it.executeLine("X = [ 1 2 3 ]");
+        it.cancelToken().cancel();
+        Assert::ExpectException<mathcore::CancelledError>([&] { it.executeLine("X = X * 2"); });
+        auto r = it.tryExecuteLine("Y = 1");
+        Assert::IsTrue(r.error && r.error->code == mathcore::ErrorCode::Cancelled);
+        Assert::IsTrue(it.ctx().find("Y") == nullptr);
+
+        it.cancelToken().reset();
+        Assert::AreEqual(std::string("[ 1 2 3 ]"), (*it.executeLine("X"))->toString());
+    }
+
+    TEST_METHOD(TimeLimitStopsLongKernel) {
+        std::string m = "[";
+        for (int i = 0; i < 150; ++i) {
+            if (i) m += ";";
+            for (int j = 0; j < 150; ++j) m += " " + std::to_string((i * j) % 7 + 1) + "/" + std::to_string(j % 3 + 2);
+        }
+        m += " ]";
+        mathcore::Interpreter it;
+        it.executeLine("M = " + m);
+        mathcore::TimeLimits limits;
+        limits.line = std::chrono::milliseconds(1);
+        it.setTimeLimits(limits);
+        Assert::ExpectException<mathcore::CancelledError>([&] { it.executeLine("P = M * M * M"); });
+        Assert::IsTrue(it.ctx().find("P") == nullptr);
+        Assert::AreEqual(std::string("2"), (*it.executeLine("1 + 1"))->toString());
+
+        limits = {};
+        limits.session = std::chrono::milliseconds(1);
+        it.setTimeLimits(limits);
+        Assert::ExpectException<mathcore::CancelledError>([&] { it.executeLine("P = M * M * M"); });
+        Assert::ExpectException<mathcore::CancelledError>([&] { it.executeLine("1 + 1"); });
+    }
+    };
+
+    TEST_CLASS(BatchTests) {
+public:
+    TEST_METHOD(SweepSharesIndependentLines) {
+        mathcore::Interpreter it;
+        it.executeLine("M = [ 1 2; 3 4 ]");
+        const std::string script =
+            "P = M ^ 3\n"
+            "V = P * [ 1 R ]\n"
+            "V\n"
+            "sum(P)\n"
+            "R = 0\n"
+            "R + trace(P)";
+        std::vector<mathcore::Bindings> runs;
+        for (int r = 1; r <= 3; ++r) runs.push_back({ { "R", mathcore::RationalValue::create(r) } });
+
+        auto res = it.executeBatch(script, runs);
+        Assert::AreEqual(size_t(3), res.size());
+        const char* expected[] = { "[ 91 199 ]", "[ 145 317 ]", "[ 199 435 ]" };
+        for (size_t r = 0; r < res.size(); ++r) {
+            Assert::IsTrue(res[r].ok());
+            Assert::AreEqual(size_t(3), res[r].values.size());
+            Assert::AreEqual(std::string(expected[r]), res[r].values[0]->toString());
+            Assert::AreEqual(std::string("290"), res[r].values[1]->toString());
+            Assert::AreEqual(std::string("155"), res[r].values[2]->toString());
+        }
+        // P и последняя строка не зависят от R: одно значение на все прогоны
+        Assert::IsTrue(res[0].vars.at("P") == res[2].vars.at("P"));
+        Assert::IsTrue(res[0].values[2] == res[1].values[2]);
+        Assert::IsTrue(it.ctx().find("P") == nullptr);
+    }
+
+    TEST_METHOD(ErrorsStopOnlyTheirRun) {
+        mathcore::Interpreter it;
+        std::vector<mathcore::Bindings> runs = {
+            { { "D", mathcore::RationalValue::create(2) } },
+            { { "D", mathcore::RationalValue::create(0) } },
+        };
+        auto res = it.executeBatch("X = 1 / D\nX + 1", runs);
+        Assert::IsTrue(res[0].ok());
+        Assert::AreEqual(std::string("1+(1/2)"), res[0].values[0]->toString());
+        Assert::IsFalse(res[1].ok());
+        Assert::AreEqual(1, res[1].error->line);
+
+        auto bad = it.executeBatch("Y = 1\nY = (", runs);
+        Assert::IsTrue(bad[0].error && bad[0].error->line == 2);
+        Assert::IsTrue(bad[0].values.empty());
+    }
+
+    TEST_METHOD(ModeLinesInBatch) {
+        mathcore::Interpreter it;
+        std::vector<mathcore::Bindings> runs = { { { "D", mathcore::RationalValue::create(3) } } };
+        auto res = it.executeBatch("mode fast\n1 / D\nmode exact\n1 / 3", runs);
+        Assert::IsTrue(res[0].ok());
+        Assert::AreEqual(std::string("0.3333333333"), res[0].values[0]->toString());
+        Assert::AreEqual(std::string("1/3"), res[0].values[1]->toString());
+    }
+    };
+
+    TEST_CLASS(NonThrowingApiTests) {
+public:
+    TEST_METHOD(TryExecuteReportsStructuredErrors) {
+        mathcore::Interpreter it;
+        auto ok = it.tryExecuteLine("X = [ 1 2 ] * 2");
+        Assert::IsTrue(ok.ok());
+        Assert::IsFalse(ok.value.has_value());
+
+        auto bad = it.tryExecuteLine("X + (1");
+        Assert::IsFalse(bad.ok());
+        Assert::IsTrue(bad.error->code == mathcore::ErrorCode::ExpectedRParen);
+        Assert::AreEqual(7, bad.error->col);
+
+        auto unknown = it.tryExecuteLine("Y * 2");
+        Assert::IsTrue(unknown.error->code == mathcore::ErrorCode::UnknownVariable);
+
+        auto eval = it.tryExecuteLine("X + [ 1 2 3 ]");
+        Assert::IsTrue(eval.error->code == mathcore::ErrorCode::Evaluation);
+    }
+
+    TEST_METHOD(EvaluationErrorsComeAsStatus) {
+        mathcore::Interpreter it;
+        const auto expect = [&](const char* line, const char* message) {
+            auto r = it.tryExecuteLine(line);
+            Assert::IsFalse(r.ok());
+            Assert::IsFalse(r.value.has_value());
+            Assert::IsTrue(r.error->code == mathcore::ErrorCode::Evaluation);
+            Assert::AreEqual(std::string(message), r.error->message);
+        };
+        expect("[ 1 2 ] + [ 1 2 3 ]", "Нельзя сложить векторы разных размеров.");
+        expect("1 / 0", "Деление на ноль.");
+        expect("[ 1 2 ] ./ [ 0 1 ]", "Деление на ноль.");
+        expect("[ 1 2; 3 4 ] ^ (1/2)", "Матрицу можно возводить только в целую неотрицательную степень.");
+        expect("[ 1 2; 3 4 ] * [ 1 2 3 ]", "Нельзя умножить: число столбцов матрицы не равно размеру вектора.");
+        expect("det(1, 2)", "Функция det ожидает аргументов: 1.");
+
+        // Ошибка указывает на операцию, а не на начало строки
+        auto r = it.tryExecuteLine("2 + 1 / 0");
+        Assert::AreEqual(7, r.error->col);
+
+        // executeLine по-прежнему бросает EvalError
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("1 / 0"); });
+        Assert::IsTrue(it.tryExecuteLine("X = 1 + 1").ok());
+    }
+
+    TEST_METHOD(ValidateScriptOnlyParses) {
+        mathcore::Interpreter it;
+        auto diags = it.validateScript("A = [ 1 2 ]\nB = A * 2\nC = Q + 1\n\nD = (A\nE = A $ 1\nF = foo(A)");
+        Assert::AreEqual(size_t(4), diags.size());
+        Assert::AreEqual(3, diags[0].line);
+        Assert::IsTrue(diags[0].code == mathcore::ErrorCode::UnknownVariable);
+        Assert::AreEqual(5, diags[1].line);
+        Assert::IsTrue(diags[1].code == mathcore::ErrorCode::ExpectedRParen);
+        Assert::IsTrue(diags[2].code == mathcore::ErrorCode::InvalidCharacter);
+        Assert::IsTrue(diags[3].code == mathcore::ErrorCode::UnknownFunction);
+        Assert::IsTrue(it.ctx().find("A") == nullptr);
+    }
+    };
+
+    TEST_CLASS(OptimizerTests) {
+public:
+    TEST_METHOD(FoldsConstantLiterals) {
+        auto p = mathcore::Parser::parseLine("Y = [ 1 2 3 ] * (1 / 3)");
+        mathcore::optimize(p.stmt);
+        Assert::IsTrue(p.stmt.expr->kind == mathcore::NodeKind::Literal);
+        Assert::AreEqual(std::string("[ 1/3 2/3 1 ]"), p.stmt.expr->value->toString());
+    }
+
+    TEST_METHOD(FoldingFollowsFastMode) {
+        mathcore::Interpreter it;
+        it.executeLine("mode fast");
+        it.executeLine("A = 10000000000");
+        const char* lines[][2] = {
+            { "10000000000 * 10000000000", "A * A" },
+            { "[ 1 2; 3 4 ] * (1/3)", "[ 1 2; 3 4 ] * (1/A) * (A/3)" },
+            { "-(1/3) + 2 ^ 70", "-(1/3) + 2 ^ (A / 10000000000 * 70)" },
+        };
+        for (auto& l : lines) {
+            auto folded = mathcore::Parser::parseLine(l[0]);
+            mathcore::optimize(folded.stmt, mathcore::NumericMode::Fast);
+            Assert::IsTrue(folded.stmt.expr->kind == mathcore::NodeKind::Literal);
+            Assert::AreEqual((*it.executeLine(l[1]))->toString(), (*it.executeLine(l[0]))->toString());
+        }
+        Assert::AreEqual(std::string("100000000000000000000.0000000000"), (*it.executeLine("10000000000 * 10000000000"))->toString());
+
+        // Пакет сворачивает строки в режиме, действующем на каждой из них
+        auto res = it.executeBatch("2 ^ 70\nmode exact\n1/3", { {} });
+        Assert::IsTrue(res[0].ok());
+        Assert::AreEqual((*it.executeLine("2 ^ (A / 10000000000 * 70)"))->toString(), res[0].values[0]->toString());
+        Assert::AreEqual(std::string("1/3"), res[0].values[1]->toString());
+    }
+
+    TEST_METHOD(SharesRepeatedSubexpressions) {
+        auto p = mathcore::Parser::parseLine("X = (M1 * V1) + (M1 * V1) * R");
+        mathcore::optimize(p.stmt);
+        auto& sum = *p.stmt.expr;
+        Assert::IsTrue(sum.args[0].get() == sum.args[1]->args[0].get());
+        Assert::IsTrue(sum.args[0]->slot >= 0);
+
+        mathcore::Interpreter it;
+        it.executeLine("M1 = [ 1 0; 0 2 ]");
+        it.executeLine("V1 = [ 1 1 ]");
+        it.executeLine("R = 1/2");
+        Assert::AreEqual(std::string("[ 1+(1/2) 3 ]"), (*it.executeLine("(M1 * V1) + (M1 * V1) * R"))->toString());
+    }
+
+    TEST_METHOD(NativeNegation) {
+        mathcore::Interpreter it;
+        Assert::AreEqual(std::string("[ -1 -2 ]"), (*it.executeLine("-[ 1 2 ]"))->toString());
+        Assert::AreEqual(std::string("-1/2"), (*it.executeLine("-(1/2)"))->toString());
+    }
+    };
+
+    TEST_CLASS(PowerTests) {
+public:
+    TEST_METHOD(RationalPowers) {
+        mathcore::Interpreter it;
+        Assert::AreEqual(std::string("8/27"), (*it.executeLine("(2/3)^3"))->toString());
+        Assert::AreEqual(std::string("2+(1/4)"), (*it.executeLine("(2/3)^-2"))->toString());
+        Assert::AreEqual(std::string("-4"), (*it.executeLine("-2^2"))->toString());
+        Assert::AreEqual(std::string("512"), (*it.executeLine("2^3^2"))->toString());
+        Assert::AreEqual(std::string("1"), (*it.executeLine("5^0"))->toString());
+    }
+
+    TEST_METHOD(MatrixPowerMatchesRepeatedProduct) {
+        mathcore::Interpreter it;
+        it.executeLine("M = [ 1 1; 1 0 ]");
+        Assert::AreEqual(std::string("[\n89 55;\n55 34\n]"), (*it.executeLine("M ^ 10"))->toString());
+        Assert::AreEqual(std::string("[\n1 0;\n0 1\n]"), (*it.executeLine("M ^ 0"))->toString());
+
+        it.executeLine("P = [ 1/2 1/2; 1/4 3/4 ]");
+        Assert::AreEqual((*it.executeLine("P * P * P * P * P"))->toString(), (*it.executeLine("P ^ 5"))->toString());
+    }
+
+    TEST_METHOD(ComplexPower) {
+        mathcore::Interpreter it;
+        Assert::AreEqual(std::string("-1.0000000000"), (*it.executeLine("i ^ 2"))->toString());
+    }
+    };
+
+    TEST_CLASS(ReductionTests) {
+public:
+    TEST_METHOD(ExactRationalReductions) {
+        mathcore::Interpreter it;
+        it.executeLine("V = [ 1/2 1/3 1/6 ]");
+        Assert::AreEqual(std::string("1"), (*it.executeLine("sum(V)"))->toString());
+        Assert::AreEqual(std::string("1/3"), (*it.executeLine("mean(V)"))->toString());
+        Assert::AreEqual(std::string("1/6"), (*it.executeLine("min(V)"))->toString());
+        Assert::AreEqual(std::string("1/2"), (*it.executeLine("max(V)"))->toString());
+        Assert::AreEqual(std::string("1/2"), (*it.executeLine("dot(V, [ 1 0 0 ])"))->toString());
+        Assert::AreEqual(std::string("5"), (*it.executeLine("norm([ 3 4 ])"))->toString());
+        Assert::AreEqual(std::string("5"), (*it.executeLine("trace([ 1 2; 3 4 ])"))->toString());
+    }
+
+    TEST_METHOD(LargeIntegerDotUsesChunks) {
+        std::string v = "[";
+        for (int k = 1; k <= 40000; ++k) v += " " + std::to_string(k % 7);
+        v += " ]";
+        mathcore::Interpreter it;
+        it.executeLine("V = " + v);
+        int64_t expected = 0;
+        for (int k = 1; k <= 40000; ++k) expected += int64_t(k % 7) * (k % 7);
+        Assert::AreEqual(std::to_string(expected), (*it.executeLine("dot(V, V)"))->toString());
+    }
+
+    TEST_METHOD(ArityIsChecked) {
+        mathcore::Interpreter it;
+        auto r = it.tryExecuteLine("dot([ 1 2 ])");
+        Assert::IsFalse(r.ok());
+    }
+    };
+
+    TEST_CLASS(LinearAlgebraTests) {
+public:
+    TEST_METHOD(DetInvSolveRank) {
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 2 1; 1 3 ]");
+        Assert::AreEqual(std::string("5"), (*it.executeLine("det(A)"))->toString());
+        Assert::AreEqual(std::string("[\n3/5 -1/5;\n-1/5 2/5\n]"), (*it.executeLine("inv(A)"))->toString());
+        Assert::AreEqual(std::string("[ 1 2 ]"), (*it.executeLine("solve(A, [ 4 7 ])"))->toString());
+        Assert::AreEqual(std::string("[\n1 0;\n0 1\n]"), (*it.executeLine("A * inv(A)"))->toString());
+        Assert::AreEqual(std::string("1"), (*it.executeLine("rank([ 1 2 3; 2 4 6 ])"))->toString());
+        Assert::AreEqual(std::string("-2"), (*it.executeLine("det([ 0 1; 2 0 ])"))->toString());
+        Assert::AreEqual(std::string("1/12"), (*it.executeLine("det([ 1/2 0; 0 1/6 ])"))->toString());
+        Assert::IsFalse(it.tryExecuteLine("inv([ 1 2; 2 4 ])").ok());
+        Assert::IsFalse(it.tryExecuteLine("det([ 1 2 3; 4 5 6 ])").ok());
+    }
+
+    TEST_METHOD(SmallFixedSizeKernels) {
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 2 0 1 3; 1 1 0 2; 0 4 1 1; 3 1 2 0 ]");
+        Assert::AreEqual(std::string("-28"), (*it.executeLine("det(A)"))->toString());
+        Assert::AreEqual(std::string("[\n1 0 0 0;\n0 1 0 0;\n0 0 1 0;\n0 0 0 1\n]"), (*it.executeLine("inv(A) * A"))->toString());
+        Assert::AreEqual(std::string("[ 6 4 6 6 ]"), (*it.executeLine("A * [ 1 1 1 1 ]"))->toString());
+        Assert::AreEqual(std::string("[\n2 1 0 3;\n0 1 4 1;\n1 0 1 2;\n3 2 1 0\n]"), (*it.executeLine("T(A)"))->toString());
+        Assert::AreEqual(std::string("-5.0000000000"), (*it.executeLine("det([ 2*i 1*i; 1*i 3*i ])"))->toString());
+        Assert::AreEqual(std::string("[ -4.0000000000 -7.0000000000 ]"), (*it.executeLine("[ 2*i 1*i; 1*i 3*i ] * [ i 2*i ]"))->toString());
+    }
+
+    TEST_METHOD(DerivedDataIsCachedPerValue) {
+        auto m = std::make_shared<mathcore::MatrixValue>(2, 2, std::vector<int64_t>{ 1, 2, 2, 5 });
+        Assert::IsTrue(&m->lu() == &m->lu());
+        Assert::IsTrue(m->transpose() == m->transpose());
+        Assert::IsTrue(m->isSymmetric());
+        Assert::IsFalse(m->isDiagonal());
+        Assert::AreEqual(size_t(2), m->rank());
+    }
+    };
+
+    TEST_CLASS(HashingTests) {
+public:
+    TEST_METHOD(StructuralHashAndEquality) {
+        mathcore::Interpreter it;
+        auto a = *it.executeLine("[ 1 2 3 ] * 2");
+        auto b = *it.executeLine("[ 2 4 6 ]");
+        auto c = *it.executeLine("[ 2 4 7 ]");
+        Assert::IsTrue(a != b);
+        Assert::IsTrue(a->hash() == b->hash());
+        Assert::IsTrue(a->equals(*b));
+        Assert::IsFalse(a->equals(*c));
+        Assert::IsTrue((*it.executeLine("[ 1/2 i ]"))->equals(**it.executeLine("[ 2/4 i ]")));
+        Assert::IsFalse((*it.executeLine("1"))->equals(**it.executeLine("[ 1; 1 ]")));
+    }
+
+    TEST_METHOD(InternSharesEqualValues) {
+        auto base = std::make_shared<mathcore::Context>();
+        base->vars["B"] = std::make_shared<mathcore::MatrixValue>(2, 2, std::vector<int64_t>{ 1, 2, 3, 4 });
+        mathcore::Interpreter it(base);
+        it.executeLine("X = [ 1 2; 3 4 ]");
+        it.executeLine("Y = [ 1 2; 3 4 ] + 0");
+        it.executeLine("V = [ 5 6 ]");
+        it.executeLine("W = [ 5 6 ]");
+        Assert::AreEqual(size_t(3), it.internValues());
+        auto& v = it.ctx().vars;
+        Assert::IsTrue(v.at("X") == base->vars.at("B"));
+        Assert::IsTrue(v.at("Y") == base->vars.at("B"));
+        Assert::IsTrue(v.at("V") == v.at("W"));
+        Assert::AreEqual(size_t(0), it.internValues());
+    }
+    };
+
+    TEST_CLASS(MemoryTests) {
+public:
+    TEST_METHOD(FootprintCountsStorage) {
+        mathcore::VectorValue ints(std::vector<int64_t>(1000, 7));
+        Assert::IsTrue(ints.footprint() >= 1000 * sizeof(int64_t));
+        const size_t before = ints.footprint();
+        ints.items(); // ленивая упаковка добавляет элементы
+        Assert::IsTrue(ints.footprint() > before + 1000 * sizeof(mathcore::ValuePtr));
+    }
+
+    TEST_METHOD(LimitRejectsBeforeAllocating) {
+        mathcore::Interpreter it;
+        it.executeLine("V = [ 1 2 3 4 5 6 7 8 9 10 ]");
+        it.setMemoryLimit(it.contextBytes() + 4096);
+        it.executeLine("S = sum(V)");
+        auto r = it.tryExecuteLine("W = V .* [ 1; 2; 3; 4; 5; 6; 7; 8; 9; 10 ] ./ 3");
+        Assert::IsFalse(r.ok());
+        Assert::IsTrue(it.ctx().vars.count("W") == 0);
+        it.setMemoryLimit(0);
+        Assert::IsTrue(it.tryExecuteLine("W = V .* [ 1; 2; 3; 4; 5; 6; 7; 8; 9; 10 ] ./ 3").ok());
+        auto usage = it.memoryUsage();
+        Assert::AreEqual(std::string("W"), usage.front().first);
+    }
+
+    TEST_METHOD(ScalarFactorChangesEstimatedStorage) {
+        mathcore::Interpreter it;
+        std::string lit = "M = [";
+        for (int i = 0; i < 30; ++i) {
+            for (int j = 0; j < 30; ++j) lit += " " + std::to_string(i + j);
+            lit += i + 1 < 30 ? ";" : " ]";
+        }
+        it.executeLine(lit);
+        it.executeLine("H = 1/2");
+        // Хватает на целочисленный результат, но не на рациональный или комплексный
+        it.setMemoryLimit(it.contextBytes() + mathcore::MatrixValue::estimateFootprint(30, 30, true) + 1024);
+        Assert::IsTrue(it.tryExecuteLine("M * 2").ok());
+        auto half = it.tryExecuteLine("M * H");
+        Assert::IsFalse(half.ok());
+        Assert::IsTrue(half.error->message.find("Превышен лимит памяти") == 0);
+        Assert::IsFalse(it.tryExecuteLine("M * i").ok());
+
+        // В режиме fast результат упакован: complex<double> на элемент
+        it.executeLine("mode fast");
+        it.setMemoryLimit(it.contextBytes() + mathcore::MatrixValue::estimatePackedFootprint(30, 30) + 1024);
+        Assert::IsTrue(it.tryExecuteLine("M * H").ok());
+    }
+
+    TEST_METHOD(ZeroDivisorCheckDoesNotBoxIntegers) {
+        mathcore::Interpreter it;
+        it.executeLine("D = [ 3 0 5 ]");
+        it.executeLine("E = [ 1 0; 3 4 ]");
+        const size_t before = it.contextBytes();
+        Assert::IsFalse(it.tryExecuteLine("[ 1 2 3 ] ./ D").ok());
+        Assert::IsFalse(it.tryExecuteLine("2 ./ E").ok());
+        Assert::AreEqual(before, it.contextBytes());
+    }
+    };
+
+    TEST_CLASS(BroadcastTests) {
+public:
+    TEST_METHOD(ElementwiseOperators) {
+        mathcore::Interpreter it;
+        Assert::AreEqual(std::string("[ 3 8 ]"), (*it.executeLine("[ 1 2 ] .* [ 3 4 ]"))->toString());
+        Assert::AreEqual(std::string("[ 1/3 1/2 ]"), (*it.executeLine("[ 1 2 ] ./ [ 3 4 ]"))->toString());
+        Assert::AreEqual(std::string("[ 4 6 ]"), (*it.executeLine("2.*[ 2 3 ]"))->toString());
+        Assert::IsFalse(it.tryExecuteLine("[ 1 2 ] ./ [ 0 1 ]").ok());
+    }
+
+    TEST_METHOD(ScalarRowAndColumnBroadcast) {
+        mathcore::Interpreter it;
+        it.executeLine("M = [ 1 2; 3 4 ]");
+        Assert::AreEqual(std::string("[\n2 3;\n4 5\n]"), (*it.executeLine("M + 1"))->toString());
+        Assert::AreEqual(std::string("[ 0 -1 ]"), (*it.executeLine("1 - [ 1 2 ]"))->toString());
+        Assert::AreEqual(std::string("[\n11 22;\n13 24\n]"), (*it.executeLine("M + [ 10 20 ]"))->toString());
+        Assert::AreEqual(std::string("[\n11 12;\n23 24\n]"), (*it.executeLine("M + [ 10; 20 ]"))->toString());
+        Assert::AreEqual(std::string("[\n10 20;\n60 80\n]"), (*it.executeLine("M .* [ 10; 20 ]"))->toString());
+        Assert::IsFalse(it.tryExecuteLine("M + [ 1 2 3 ]").ok());
+        Assert::IsFalse(it.tryExecuteLine("[ 1 2 ] + [ 1 2 3 ]").ok());
+    }
+
+    TEST_METHOD(LargeMatrixMatchesSmallPath) {
+        // 200x200 = 40000 элементов — считается кусками на нескольких потоках
+        std::string m = "[";
+        for (int i = 0; i < 200; ++i) {
+            if (i) m += ";";
+            for (int j = 0; j < 200; ++j) m += " " + std::to_string((i + j) % 5);
+        }
+        m += " ]";
+        mathcore::Interpreter it;
+        it.executeLine("M = " + m);
+        it.executeLine("S = M .* M - M .* M");
+        Assert::AreEqual(std::string("0"), (*it.executeLine("sum(S)"))->toString());
+        Assert::AreEqual(std::string("[ 1/2 1 ]"), (*it.executeLine("trace(M ./ 2) .* [ 0 0 ] + [ 1/2 1 ]"))->toString());
+    }
+    };
+
+    TEST_CLASS(ParallelTests) {
+public:
+    TEST_METHOD(PoolMatchesSingleThreadMode) {
+        // Дробные элементы — упакованный путь; маленький grain дробит задачи на много кусков
+        std::string m = "[";
+        for (int i = 0; i < 40; ++i) {
+            if (i) m += ";";
+            for (int j = 0; j < 30; ++j) m += " " + std::to_string((i * 7 + j) % 11) + "/" + std::to_string(j % 4 + 1);
+        }
+        m += " ]";
+        auto run = [&](unsigned threads) {
+            mathcore::Interpreter it;
+            mathcore::ParallelOptions opts;
+            opts.threads = threads;
+            opts.grain = 64;
+            it.setParallelOptions(opts);
+            it.executeLine("M = " + m);
+            std::string out;
+            for (auto* e : { "M * T(M)", "T(M) * M", "-M / 3", "2 * M - M .* M", "sum(M .* M)" })
+                out += (*it.executeLine(e))->toString() + "\n";
+            return out;
+        };
+        mathcore::setThreadPoolSize(4);
+        const std::string pooled = run(0);
+        mathcore::setThreadPoolSize(0);
+        Assert::AreEqual(run(1), pooled);
+    }
+
+    TEST_METHOD(ErrorInParallelChunkIsReported) {
+        mathcore::setThreadPoolSize(4);
+        mathcore::Interpreter it;
+        mathcore::ParallelOptions opts;
+        opts.grain = 16;
+        it.setParallelOptions(opts);
+        std::string v = "[";
+        for (int i = 0; i < 1000; ++i) v += " " + std::to_string(i % 7) + "/2";
+        v += " ]";
+        it.executeLine("V = " + v);
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("1 ./ V"); });
+        mathcore::setThreadPoolSize(0);
+    }
+    };
+
+    TEST_CLASS(ProductChainTests) {
+public:
+    TEST_METHOD(ChainIsEvaluatedInCheapestOrder) {
+        auto matrix = [](int seed) {
+            std::string m = "[";
+            for (int i = 0; i < 100; ++i) {
+                if (i) m += ";";
+                for (int j = 0; j < 100; ++j) m += " " + std::to_string((i * seed + j) % 7);
+            }
+            return m + " ]";
+        };
+        std::string v = "[";
+        for (int i = 0; i < 100; ++i) v += " " + std::to_string(i % 5);
+        v += " ]";
+
+        mathcore::Interpreter it;
+        it.executeLine("A = " + matrix(3));
+        it.executeLine("B = " + matrix(5));
+        it.executeLine("V = " + v);
+        it.executeLine("P = A * B");
+        const std::string expected = (*it.executeLine("P * V"))->toString();
+        Assert::AreEqual(expected, (*it.executeLine("A * B * V"))->toString());
+        Assert::AreEqual(expected, (*it.executeLine("2 * A * B * V * (1/2)"))->toString());
+
+        // A * (B * V): промежуточные результаты — векторы, матрица 100x100 не создаётся
+        it.executeLine("P = 0");
+        it.setMemoryLimit(it.contextBytes() + 20000);
+        Assert::AreEqual(expected, (*it.executeLine("A * B * V"))->toString());
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("A * B"); });
+    }
+    };
+
+    TEST_CLASS(SnapshotTests) {
+public:
+    TEST_METHOD(ReadersSeeConsistentVersions) {
+        mathcore::Interpreter it;
+        it.executeLine("X = 0");
+        it.executeLine("Y = 0");
+        std::atomic<bool> done{ false };
+        std::atomic<int> inconsistent{ 0 };
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&] {
+                uint64_t last = 0;
+                while (!done) {
+                    auto snap = it.snapshot();
+                    if (snap->version < last) ++inconsistent;
+                    last = snap->version;
+                    // Писатель меняет X и Y двумя строками: снимок между ними — тоже версия,
+                    // но в каждой версии X + Y равно 0 или 1
+                    auto res = it.evaluate("X + Y");
+                    const std::string s = res.ok() ? (*res.value)->toString() : "";
+                    if (s != "0" && s != "1" && s != "0.0000000000" && s != "1.0000000000") ++inconsistent;
+                }
+            });
+        }
+        for (int k = 1; k <= 300; ++k) {
+            // Режим меняется, пока читатели вычисляют: evaluate берёт его из опубликованных настроек
+            if (k % 50 == 0) it.executeLine(k % 100 ? "mode fast" : "mode exact");
+            it.executeLine("X = " + std::to_string(k));
+            it.executeLine("Y = -" + std::to_string(k));
+        }
+        done = true;
+        for (auto& t : readers) t.join();
+        Assert::AreEqual(0, inconsistent.load());
+
+        // Снимок неизменяем: последующие присваивания его не меняют
+        auto before = it.snapshot();
+        Assert::IsTrue(before == it.snapshot()); // без изменений копия не пересобирается
+        it.executeLine("X = 1000");
+        Assert::AreEqual(std::string("300"), (*before->find("X"))->toString());
+        Assert::IsTrue(it.version() > before->version);
+        Assert::IsTrue(!it.evaluate("Z = X").value && !it.snapshot()->find("Z"));
+    }
+
+    TEST_METHOD(WriterPublishesEveryVersion) {
+        mathcore::Interpreter it;
+        // Слои поверх полной копии и её пересборки: каждая версия видит все переменные
+        for (int k = 0; k < 500; ++k) {
+            it.executeLine("V" + std::to_string(k) + " = " + std::to_string(k));
+            auto snap = it.snapshot();
+            Assert::IsTrue(snap == it.snapshot()); // читатель ничего не собирает
+            Assert::AreEqual(it.ctx().version, snap->version);
+            Assert::IsTrue(snap->find("V0") && snap->find("i"));
+            Assert::AreEqual(std::to_string(k), (*snap->find("V" + std::to_string(k)))->toString());
+        }
+        it.executeLine("V0 = 7");
+        Assert::AreEqual(std::string("7"), (*it.snapshot()->find("V0"))->toString());
+        Assert::AreEqual(std::string("506"), (*it.evaluate("V0 + V499").value)->toString());
+    }
+    };
+
+    TEST_CLASS(NumericModeTests) {
+public:
+    TEST_METHOD(FastModeComputesInDoublesUntilExact) {
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 1 2; 3 4 ]");
+        it.executeLine("V = [ 1/2 1/3 ]");
+        Assert::AreEqual(std::string("[ 1+(1/6) 2+(5/6) ]"), (*it.executeLine("A * V"))->toString());
+
+        it.executeLine("mode fast");
+        Assert::IsTrue(it.numericMode() == mathcore::NumericMode::Fast);
+        Assert::AreEqual(std::string("[ 1.1666666667 2.8333333333 ]"), (*it.executeLine("A * V"))->toString());
+        it.executeLine("B = A / 3 - T(A) .* V");
+        auto b = std::static_pointer_cast<mathcore::MatrixValue>(*it.executeLine("B"));
+        Assert::IsTrue(b->isPacked());
+        Assert::AreEqual(std::string("[\n-0.1666666667 -0.3333333333;\n0.0000000000 0.0000000000\n]"), b->toString());
+        Assert::AreEqual(std::string("0.3333333333"), (*it.executeLine("1/3"))->toString());
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("B ./ 0"); });
+
+        // Упакованная матрица равна такой же с элементами-Value
+        Assert::IsTrue(b->equals(*std::make_shared<mathcore::MatrixValue>(b->data())));
+
+        it.executeLine("mode exact");
+        Assert::AreEqual(std::string("[ 1+(1/6) 2+(5/6) ]"), (*it.executeLine("A * V"))->toString());
+        auto slow = it.tryExecuteLine("mode slow");
+        Assert::IsTrue(slow.error && slow.error->code == mathcore::ErrorCode::UnknownMode);
+    }
+
+    TEST_METHOD(FastModePowerAndExtremaOnRealData) {
+        mathcore::Interpreter it;
+        it.executeLine("mode fast");
+        // Показатель тоже неточный (комплексный с нулевой мнимой частью)
+        Assert::AreEqual(std::string("[\n37.0000000000 54.0000000000;\n81.0000000000 118.0000000000\n]"),
+            (*it.executeLine("[ 1 2; 3 4 ] ^ 3"))->toString());
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("[ 1 2; 3 4 ] ^ (1/2)"); });
+        Assert::AreEqual(std::string("2.5000000000"), (*it.executeLine("max([ 1 5/2 (0 - 3) ])"))->toString());
+        Assert::AreEqual(std::string("-3.0000000000"), (*it.executeLine("min([ 1 5/2 (0 - 3) ])"))->toString());
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("max([ 1 i ])"); });
+    }
+    };
+
+    TEST_CLASS(DispatchTests) {
+public:
+    TEST_METHOD(MixedKindsGoThroughDirectKernels) {
+        mathcore::Interpreter it;
+        it.executeLine("C = (-4) ^ (1/2)");
+        auto str = [&](const char* line) { return (*it.executeLine(line))->toString(); };
+        // Рациональное с комплексным — в обе стороны, без временного комплексного значения
+        Assert::AreEqual(std::string("0.5000000000+2.0000000000i"), str("1/2 + C"));
+        Assert::AreEqual(std::string("-0.5000000000+2.0000000000i"), str("C - 1/2"));
+        Assert::AreEqual(std::string("-1.5000000000i"), str("3 / C"));
+        // Скаляр слева от вектора или матрицы расширяется без перестановки операндов
+        Assert::AreEqual(std::string("[ 1/2 1 1+(1/2) ]"), str("(1/2) * [ 1 2 3 ]"));
+        Assert::AreEqual(std::string("[ -1/2 -1+(1/2) ]"), str("1/2 - [ 1 2 ]"));
+        Assert::AreEqual(std::string("[\n0 -1;\n-2 -3\n]"), str("1 - [ 1 2; 3 4 ]"));
+        // Прямые вызовы методов дают то же, что таблица
+        auto half = mathcore::RationalValue::create(1, 2);
+        auto c = *it.executeLine("C");
+        Assert::IsTrue(half->add(*c)->equals(*mathcore::binaryOp(mathcore::TokType::Plus, *half, *c)));
+
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("C / 0"); });
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("2 / [ 1 2 ]"); });
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("[ 1 2 ] * [ 1 2 ]"); });
+    }
+    };
+
+    TEST_CLASS(DiskMatrixTests) {
+public:
+    TEST_METHOD(TiledKernelsMatchInMemoryResults) {
+        // Тайлы 2x2 на матрице 5x3: операции проходят по нескольким тайлам и неполным краям
+        const auto path = (std::filesystem::temp_directory_path() / "mathcore-test-a.tiles").u8string();
+        const auto saved = (std::filesystem::temp_directory_path() / "mathcore-test-b.tiles").u8string();
+        {
+            auto d = mathcore::DiskMatrixValue::create(5, 3, path, 2);
+            for (uint64_t i = 0; i < 5; ++i)
+                for (uint64_t j = 0; j < 3; ++j)
+                    d->tileData(i / 2, j / 2)[(i % 2) * 2 + j % 2] = static_cast<double>(i * 3 + j) - 4.0;
+        }
+        mathcore::Interpreter it;
+        it.executeLine("A = [ 0 1 2; 3 4 5; 6 7 8; 9 10 11; 12 13 14 ] - 4");
+        it.executeLine("D = open(\"" + path + "\")");
+        const std::pair<const char*, const char*> cases[] = {
+            { "A * T(A)", "D * T(D)" }, { "T(A) * A", "T(D) * A" }, { "A + A", "D + A" },
+            { "2 * A - A .* A", "2 * D - D .* A" }, { "-A ./ (1/2)", "-D ./ (1/2)" },
+        };
+        for (auto& [mem, disk] : cases)
+            Assert::AreEqual((*it.executeLine(mem))->toString(),
+                (*it.executeLine(std::string("load(") + disk + ")"))->toString());
+        it.executeLine("S = save(D * T(D), \"" + saved + "\")");
+        Assert::AreEqual(std::string("[\n29 2 -25 -52 -79;\n2 2 2 2 2;\n-25 2 29 56 83;\n-52 2 56 110 164;\n-79 2 83 164 245\n]"),
+            (*it.executeLine("load(S)"))->toString());
+        Assert::ExpectException<mathcore::EvalError>([&] { it.executeLine("D + [ 1 2 ]"); });
+        it.executeLine("D = 0");
+        it.executeLine("S = 0");
+        std::filesystem::remove(std::filesystem::u8path(path));
+        std::filesystem::remove(std::filesystem::u8path(saved));
+    }
+    };
+
 } // namespace MathTests